@@ -0,0 +1,168 @@
+#ifndef __BLUEGRASS_BUFFER_POOL__
+#define __BLUEGRASS_BUFFER_POOL__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace bluegrass {
+
+	class buffer_pool;
+
+	/*
+	 * "buffer_t" is a buffer checked out of the "buffer_pool". It holds at least
+	 * "size" bytes and goes back to the pool when destroyed. Buffers may be
+	 * released on any thread, not only the one which acquired them.
+	 */
+	class buffer_t {
+		friend class buffer_pool;
+	public:
+		buffer_t() = default;
+
+		buffer_t(buffer_t const&) = delete;
+		buffer_t& operator=(buffer_t const&) = delete;
+
+		buffer_t(buffer_t&& other) :
+			data_ {std::exchange(other.data_, nullptr)},
+			size_ {std::exchange(other.size_, 0)},
+			capacity_ {std::exchange(other.capacity_, 0)}
+		{}
+
+		buffer_t& operator=(buffer_t&& other)
+		{
+			if (this != &other) {
+				release();
+				data_ = std::exchange(other.data_, nullptr);
+				size_ = std::exchange(other.size_, 0);
+				capacity_ = std::exchange(other.capacity_, 0);
+			}
+			return *this;
+		}
+
+		~buffer_t()
+		{
+			release();
+		}
+
+		explicit operator bool() const
+		{
+			return data_;
+		}
+
+		std::byte* data() const
+		{
+			return data_;
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		// bytes usable in the buffer, at least "size"
+		size_t capacity() const
+		{
+			return capacity_;
+		}
+
+		// shrinks or grows the used bytes within "capacity"
+		void resize(size_t size)
+		{
+			size_ = size <= capacity_ ? size : capacity_;
+		}
+
+		std::span<std::byte> span() const
+		{
+			return {data_, size_};
+		}
+
+		// returns the buffer to the pool early
+		void release();
+
+	private:
+		buffer_t(std::byte* data, size_t size, size_t capacity) :
+			data_ {data}, size_ {size}, capacity_ {capacity}
+		{}
+
+		std::byte* data_ {nullptr};
+		size_t size_ {0};
+		size_t capacity_ {0};
+	};
+
+	/*
+	 * "buffer_pool" hands out buffers in power of two size classes from "MIN" to
+	 * "MAX" bytes, carved out of slabs which are never given back to the system.
+	 * Every thread caches up to "CACHED" free buffers per class, so a checkout
+	 * and a return on the same thread take no lock; a thread exchanges half of
+	 * its cache with the shared free lists when it runs empty or full. Requests
+	 * above "MAX" are allocated and freed on their own.
+	 */
+	class buffer_pool {
+		friend class buffer_t;
+	public:
+		static constexpr size_t MIN {64};
+		static constexpr size_t MAX {64 * 1024};
+		static constexpr size_t CLASSES {11};
+		static constexpr size_t CACHED {32};
+		static constexpr size_t SLAB {256 * 1024};
+
+		// "buffer_pool" singleton accessor function
+		static buffer_pool& access()
+		{
+			static buffer_pool buffer_pool_;
+			return buffer_pool_;
+		}
+
+		buffer_pool(buffer_pool const&) = delete;
+		buffer_pool(buffer_pool&&) = delete;
+		buffer_pool& operator=(buffer_pool const&) = delete;
+		buffer_pool& operator=(buffer_pool&&) = delete;
+
+		~buffer_pool();
+
+		// checks out a buffer of "size" bytes
+		buffer_t acquire(size_t size);
+
+	private:
+		// free buffers of one class kept by one thread
+		struct cache_t {
+			~cache_t();
+
+			std::vector<std::byte*> free[CLASSES];
+		};
+
+		buffer_pool();
+
+		// smallest class holding "size" bytes, "CLASSES" above "MAX"
+		static size_t size_class(size_t size);
+
+		void release(std::byte*, size_t capacity);
+
+		std::mutex m_;
+		std::vector<std::byte*> free_[CLASSES];
+		std::vector<std::byte*> slabs_;
+
+		inline static thread_local cache_t cache_ {};
+
+		// false once the pool is destroyed: threads outliving it, e.g. workers of a static service, return nothing to it
+		inline static std::atomic<bool> alive_ {false};
+	};
+
+	inline void buffer_t::release()
+	{
+		if (data_) {
+			if (buffer_pool::alive_) {
+				buffer_pool::access().release(data_, capacity_);
+			}
+			data_ = nullptr;
+			size_ = 0;
+			capacity_ = 0;
+		}
+	}
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef __BLUEGRASS_COMPRESSION__
+#define __BLUEGRASS_COMPRESSION__
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <span>
+
+#include "bluegrass/buffer_pool.hpp"
+#include "bluegrass/socket.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * Built-in LZ codec in the LZ4 block format: byte aligned literal runs and
+	 * back references of up to 64 KB, found through a 4096 entry hash of 4 byte
+	 * sequences. It trades ratio for speed, so compressing a payload costs far
+	 * less than sending the bytes it saves over a link of a few hundred KB/s.
+	 */
+
+	// most bytes "lz_compress" may write for "size" input bytes
+	constexpr size_t lz_bound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	// compresses "in" into "out", returns the bytes written or 0 if they do not fit in "out"
+	size_t lz_compress(std::span<const std::byte> in, std::span<std::byte> out);
+
+	// decompresses "in" into "out", returns the bytes written or -1 if "in" is malformed or "out" too short
+	ssize_t lz_decompress(std::span<const std::byte> in, std::span<std::byte> out);
+
+	// how payloads on a connection are compressed
+	struct compression_t {
+		bool enabled {true}; // offer the codec to the peer and compress toward it
+		size_t threshold {64}; // payloads below it go out uncompressed
+		std::chrono::milliseconds timeout {1000}; // wait for the peer's offer
+	};
+
+	// codecs a payload is sent with
+	enum class codec_t : uint8_t {
+		HELLO, // negotiation: "size" holds the codecs the sender decodes
+		ACK, // negotiation: the HELLO of the receiver arrived
+		RAW,
+		LZ,
+	};
+
+	// bit of "codec" in an offer
+	constexpr uint16_t offer(codec_t codec)
+	{
+		return 1 << static_cast<int>(codec);
+	}
+
+	// header of every datagram sent by a "compressor" with a negotiated peer
+	struct packed_t {
+		codec_t codec;
+		uint8_t reserved;
+		uint16_t size; // bytes of the payload before compression
+	};
+
+	/*
+	 * "compressor" sends and receives payloads of up to 64 KB over a socket and
+	 * compresses the ones of at least "threshold" bytes with the LZ codec. Both
+	 * ends of a connection must construct one, with "enabled" false to decline:
+	 * each sends a HELLO with the codecs it decodes and acknowledges the HELLO
+	 * of its peer. An end is negotiated once, within "timeout", it has received
+	 * the HELLO of its peer and an ACK of its own; only then do its datagrams
+	 * carry a header. Payloads are compressed only toward a peer which offered
+	 * the codec, and only if that makes them smaller. Without a negotiation
+	 * payloads go out as plain datagrams, and a HELLO or ACK arriving late is
+	 * a protocol error: "receive" reports it instead of handing it out as a
+	 * payload. "send" is thread-safe, "receive" must not run concurrently.
+	 */
+	class compressor {
+	public:
+		explicit compressor(socket const&, compression_t const& ={});
+
+		compressor(compressor const&) = delete;
+		compressor& operator=(compressor const&) = delete;
+
+		bool send(std::span<const std::byte> payload);
+
+		template <class T,
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		bool send(const T* data)
+		{
+			return send(std::as_bytes(std::span {data, 1}));
+		}
+
+		// receives the next payload in a pooled buffer, empty on error
+		buffer_t receive();
+
+		// the peer answered the negotiation
+		bool negotiated() const
+		{
+			return negotiated_;
+		}
+
+		// payloads toward the peer are compressed
+		bool compressing() const
+		{
+			return compressing_;
+		}
+
+		// bytes compression kept off the air so far
+		size_t saved() const
+		{
+			return saved_;
+		}
+
+	private:
+		// peeks the next datagram, true if it is a HELLO or an ACK
+		bool control(packed_t& header) const;
+
+		socket const& conn_;
+		compression_t const options_;
+
+		bool negotiated_ {false};
+		bool compressing_ {false};
+		std::atomic<size_t> saved_ {0};
+	};
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __BLUEGRASS_CONNECTION_POOL__
+#define __BLUEGRASS_CONNECTION_POOL__
+
+#include <chrono>
+#include <list>
+#include <mutex>
+
+#include "bluegrass/bluetooth.hpp"
+#include "bluegrass/socket.hpp"
+
+namespace bluegrass {
+
+	// bounds of the idle connections kept by the "connection_pool"
+	struct pool_limits_t {
+		size_t per_peer {2}; // idle connections kept per address and port
+		size_t total {16}; // idle connections kept overall
+		std::chrono::steady_clock::duration max_idle {std::chrono::seconds {30}};
+	};
+
+	/*
+	 * "connection_pool" keeps connected sockets between uses, keyed by peer address
+	 * and port, so repeated requests to a device skip L2CAP connection setup.
+	 * "borrow" hands out an idle connection when one is healthy, otherwise it
+	 * connects like the "socket" constructor and throws on failure. A connection
+	 * is healthy if it is not closed or in error and holds no unread input: input
+	 * on an idle connection belongs to no request. The connection goes back to
+	 * the pool when its lease is destroyed. Idle connections are closed once they
+	 * exceed "max_idle", and the least recently used one is closed when a limit
+	 * is exceeded.
+	 */
+	class connection_pool {
+	public:
+		// a borrowed connection, returned to the pool on destruction
+		class lease_t {
+			friend class connection_pool;
+		public:
+			lease_t(lease_t const&) = delete;
+			lease_t& operator=(lease_t const&) = delete;
+
+			lease_t(lease_t&&);
+			lease_t& operator=(lease_t&&);
+
+			~lease_t();
+
+			socket& operator*()
+			{
+				return conn_;
+			}
+
+			socket* operator->()
+			{
+				return &conn_;
+			}
+
+			// closes the connection on return instead of pooling it, e.g. after a failed transfer
+			void discard()
+			{
+				reusable_ = false;
+			}
+
+			// true if the connection was taken from the pool rather than newly connected
+			bool reused() const
+			{
+				return reused_;
+			}
+
+		private:
+			lease_t(connection_pool*, bdaddr_t, uint16_t, socket&&, bool reused);
+
+			void release();
+
+			connection_pool* pool_;
+			bdaddr_t addr_;
+			uint16_t port_;
+			socket conn_;
+			bool reusable_ {true};
+			bool reused_;
+		};
+
+		// "connection_pool" singleton accessor function
+		static connection_pool& access()
+		{
+			static connection_pool connection_pool_ {settings()};
+			return connection_pool_;
+		}
+
+		// sets the limits of the pool: only effective before the first "access"
+		static void setup(pool_limits_t const& limits)
+		{
+			settings() = limits;
+		}
+
+		explicit connection_pool(pool_limits_t const& = {});
+
+		connection_pool(connection_pool const&) = delete;
+		connection_pool(connection_pool&&) = delete;
+		connection_pool& operator=(connection_pool const&) = delete;
+		connection_pool& operator=(connection_pool&&) = delete;
+
+		~connection_pool();
+
+		lease_t borrow(bdaddr_t, uint16_t);
+
+		size_t idle();
+
+		// closes every idle connection
+		void clear();
+
+	private:
+		struct entry_t {
+			bdaddr_t addr;
+			uint16_t port;
+			socket conn;
+			std::chrono::steady_clock::time_point since;
+		};
+
+		static pool_limits_t& settings()
+		{
+			static pool_limits_t limits_ {};
+			return limits_;
+		}
+
+		// checks an idle connection without blocking
+		static bool healthy(socket const&);
+
+		void give_back(bdaddr_t, uint16_t, socket&&);
+
+		// closes idle connections past "max_idle", requires "m_"
+		void expire(std::chrono::steady_clock::time_point now);
+
+		pool_limits_t const limits_;
+		std::mutex m_;
+
+		// most recently returned first
+		std::list<entry_t> idle_;
+	};
+
+} // namespace bluegrass
+
+#endif
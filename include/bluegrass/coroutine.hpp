@@ -0,0 +1,88 @@
+#ifndef __BLUEGRASS_COROUTINE__
+#define __BLUEGRASS_COROUTINE__
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace bluegrass {
+
+	/*
+	 * "scheduler" is where a suspended coroutine is resumed once the operation it
+	 * awaits completes. Awaitables capture the scheduler of the thread which
+	 * suspended them, so a coroutine keeps running on the threads of its executor.
+	 * A coroutine suspended outside of any scheduler is resumed inline by the
+	 * thread which completes its operation.
+	 */
+	class scheduler {
+	public:
+		virtual void post(std::coroutine_handle<>) = 0;
+
+		// scheduler of the calling thread, null if the thread does not belong to one
+		static scheduler* current()
+		{
+			return current_;
+		}
+
+		static void resume(scheduler* sched, std::coroutine_handle<> handle)
+		{
+			if (sched) {
+				sched->post(handle);
+			} else {
+				handle.resume();
+			}
+		}
+
+	protected:
+		~scheduler() = default;
+
+		inline static thread_local scheduler* current_ {nullptr};
+	};
+
+	/*
+	 * "task" is the return type of a detached coroutine. A task starts suspended
+	 * and runs once handed to an executor with "spawn"; its frame is freed when
+	 * the coroutine returns. A task which is never spawned frees its frame on
+	 * destruction.
+	 */
+	class task {
+	public:
+		struct promise_type {
+			task get_return_object()
+			{
+				return task {std::coroutine_handle<promise_type>::from_promise(*this)};
+			}
+
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() {}
+			void unhandled_exception() { std::terminate(); }
+		};
+
+		task(task const&) = delete;
+		task(task&& t) : handle_ {std::exchange(t.handle_, {})} {}
+		task& operator=(task const&) = delete;
+		task& operator=(task&&) = delete;
+
+		~task()
+		{
+			if (handle_) {
+				handle_.destroy();
+			}
+		}
+
+		// gives up ownership of the suspended coroutine to whoever resumes it
+		std::coroutine_handle<> release()
+		{
+			return std::exchange(handle_, {});
+		}
+
+	private:
+		explicit task(std::coroutine_handle<promise_type> handle) : handle_ {handle} {}
+
+		std::coroutine_handle<promise_type> handle_;
+	};
+
+} // namespace bluegrass
+
+#endif
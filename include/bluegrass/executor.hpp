@@ -0,0 +1,70 @@
+#ifndef __BLUEGRASS_EXECUTOR__
+#define __BLUEGRASS_EXECUTOR__
+
+#include "bluegrass/coroutine.hpp"
+#include "bluegrass/service.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * "executor" runs coroutines on a small ENQUEUE service. Spawned tasks and
+	 * coroutines whose awaited operation completed are queued and resumed by the
+	 * executor threads, so thousands of suspended conversations share a few threads:
+	 *
+	 *	executor exec {2};
+	 *	exec.spawn([](socket& conn) -> task { auto n {co_await conn.async_receive(&msg)}; ... }(conn));
+	 *
+	 * Coroutines still suspended on an operation when the executor is destroyed
+	 * are never resumed; shutdown their sources first.
+	 */
+	class executor : public scheduler {
+	public:
+		explicit executor(threads_t const& threads = 1) :
+			service_ {[this](std::coroutine_handle<>& handle) {
+				current_ = this;
+				handle.resume();
+			}, threads}
+		{}
+
+		executor(executor const&) = delete;
+		executor(executor&&) = delete;
+		executor& operator=(executor const&) = delete;
+		executor& operator=(executor&&) = delete;
+
+		void post(std::coroutine_handle<> handle) override
+		{
+			service_.enqueue(handle);
+		}
+
+		// starts a detached coroutine on the executor threads
+		void spawn(task&& t)
+		{
+			post(t.release());
+		}
+
+		// "co_await exec.schedule()" moves the calling coroutine onto the executor threads
+		auto schedule()
+		{
+			struct awaiter {
+				executor& exec;
+
+				bool await_ready() const { return false; }
+				void await_suspend(std::coroutine_handle<> handle) { exec.post(handle); }
+				void await_resume() const {}
+			};
+			return awaiter {*this};
+		}
+
+		// stops accepting coroutines once the queued ones have run
+		void shutdown()
+		{
+			service_.shutdown();
+		}
+
+	private:
+		service<std::coroutine_handle<>, ENQUEUE> service_;
+	};
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef __BLUEGRASS_FLAT__
+#define __BLUEGRASS_FLAT__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bluegrass/buffer_pool.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * Flat wire format for structs with variable-length members. A struct is
+	 * described once, at compile time, by the members which go on the air:
+	 *
+	 *	struct chat_t {
+	 *		std::string user;
+	 *		uint32_t sent;
+	 *		std::vector<uint16_t> readings;
+	 *	};
+	 *
+	 *	template <>
+	 *	struct bluegrass::described<chat_t> : fields<&chat_t::user, &chat_t::sent, &chat_t::readings> {};
+	 *
+	 * Members are trivial types, "std::string" or "std::vector" of a trivial
+	 * type with at most 65535 elements. A datagram starts with the trivial
+	 * members and the lengths of the variable ones, packed in described order,
+	 * followed by the elements of the variable members, each aligned for its
+	 * element type. Only used bytes go on the air, unlike fixed capacity arrays.
+	 */
+	template <class T>
+	struct described;
+
+	template <class T>
+	inline constexpr bool is_described_v = requires { described<T>::count; };
+
+	// layout of one member of type "F": trivial members are stored whole
+	template <class F>
+	struct flat_field {
+		static_assert(std::is_trivial_v<F>, "flat members are trivial, std::string or std::vector of a trivial type");
+
+		static constexpr bool variable {false};
+		static constexpr size_t slot {sizeof(F)};
+		using view_t = F;
+	};
+
+	template <>
+	struct flat_field<std::string> {
+		static constexpr bool variable {true};
+		static constexpr size_t slot {sizeof(uint16_t)};
+		using element_t = char;
+		using view_t = std::string_view;
+	};
+
+	template <class E>
+	struct flat_field<std::vector<E>> {
+		static_assert(std::is_trivial_v<E>, "flat vectors hold a trivial type");
+
+		static constexpr bool variable {true};
+		static constexpr size_t slot {sizeof(uint16_t)};
+		using element_t = E;
+		using view_t = std::span<const E>;
+	};
+
+	template <class M>
+	struct member_of;
+
+	template <class C, class F>
+	struct member_of<F C::*> {
+		using type = F;
+	};
+
+	template <auto A, auto B>
+	constexpr bool same_member()
+	{
+		if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+			return A == B;
+		} else {
+			return false;
+		}
+	}
+
+	// base of every "described" specialization: lists the members on the air in wire order
+	template <auto... Members>
+	struct fields {
+		static_assert(sizeof...(Members) > 0, "a flat type describes at least one member");
+
+		static constexpr size_t count {sizeof...(Members)};
+
+		// bytes of the packed trivial members and lengths
+		static constexpr size_t fixed {(flat_field<typename member_of<decltype(Members)>::type>::slot + ...)};
+
+		static constexpr std::array<size_t, count> slots {flat_field<typename member_of<decltype(Members)>::type>::slot...};
+
+		// position of member "i" in the packed part
+		static constexpr size_t offset(size_t i)
+		{
+			size_t position {0};
+			for (size_t j {0}; j < i; ++j) {
+				position += slots[j];
+			}
+			return position;
+		}
+
+		template <auto Member>
+		static constexpr size_t index()
+		{
+			size_t i {0}, found {count};
+			((same_member<Member, Members>() ? found = i : 0, ++i), ...);
+			return found;
+		}
+
+		// calls "fn" with each described member of "value" and its index, in wire order
+		template <class T, class Fn>
+		static void each(T& value, Fn&& fn)
+		{
+			size_t i {0};
+			(fn(value.*Members, i++), ...);
+		}
+
+		// calls "fn" with the "std::type_identity" of each member type and its index, in wire order
+		template <class Fn>
+		static void visit(Fn&& fn)
+		{
+			size_t i {0};
+			(fn(std::type_identity<typename member_of<decltype(Members)>::type> {}, i++), ...);
+		}
+	};
+
+	constexpr size_t flat_align(size_t position, size_t alignment)
+	{
+		return (position + alignment - 1) / alignment * alignment;
+	}
+
+	// bytes "value" takes on the air
+	template <class T,
+	typename std::enable_if_t<is_described_v<T>, bool> = true>
+	size_t flat_size(T const& value)
+	{
+		size_t size {described<T>::fixed};
+		described<T>::each(value, [&size]<class F>(F const& member, size_t) {
+			if constexpr (flat_field<F>::variable) {
+				using E = typename flat_field<F>::element_t;
+				size = flat_align(size, alignof(E)) + member.size() * sizeof(E);
+			}
+		});
+		return size;
+	}
+
+	// writes "value" to "out", returns the bytes written or 0 if they do not fit or a member is too long
+	template <class T,
+	typename std::enable_if_t<is_described_v<T>, bool> = true>
+	size_t flat_write(T const& value, std::span<std::byte> out)
+	{
+		size_t size {flat_size(value)};
+		if (size > out.size()) {
+			return 0;
+		}
+
+		auto data {out.data()};
+		size_t tail {described<T>::fixed};
+		bool fits {true};
+		described<T>::each(value, [&]<class F>(F const& member, size_t i) {
+			size_t slot {described<T>::offset(i)};
+			if constexpr (flat_field<F>::variable) {
+				using E = typename flat_field<F>::element_t;
+				fits = fits && member.size() <= UINT16_MAX;
+				uint16_t length {static_cast<uint16_t>(member.size())};
+				std::memcpy(data + slot, &length, sizeof(length));
+
+				// padding is zeroed: no stale memory goes on the air
+				size_t start {flat_align(tail, alignof(E))};
+				std::memset(data + tail, 0, start - tail);
+				if (length) {
+					std::memcpy(data + start, member.data(), length * sizeof(E));
+				}
+				tail = start + length * sizeof(E);
+			} else {
+				std::memcpy(data + slot, &member, sizeof(F));
+			}
+		});
+		return fits ? size : 0;
+	}
+
+	/*
+	 * "flat_view" reads a flat datagram where it was received. Variable members
+	 * come back as "std::string_view" or "std::span" into the datagram, nothing
+	 * is deserialized or copied; trivial members are read by value. A view is
+	 * false if the datagram is too short for the lengths it holds, or if it
+	 * starts at an address which misaligns its arrays: buffers of the
+	 * "buffer_pool" never do. A view made from a "buffer_t" owns it, any other
+	 * view must not outlive the bytes it reads.
+	 */
+	template <class T,
+	typename std::enable_if_t<is_described_v<T>, bool> = true>
+	class flat_view {
+	public:
+		flat_view() = default;
+
+		explicit flat_view(std::span<const std::byte> datagram) :
+			datagram_ {datagram}
+		{
+			valid_ = index();
+		}
+
+		explicit flat_view(buffer_t&& buffer) :
+			buffer_ {std::move(buffer)},
+			datagram_ {buffer_.span()}
+		{
+			valid_ = index();
+		}
+
+		explicit operator bool() const
+		{
+			return valid_;
+		}
+
+		// reads a described member, e.g. "view.get<&chat_t::user>()"
+		template <auto Member>
+		auto get() const
+		{
+			constexpr size_t i {described<T>::template index<Member>()};
+			static_assert(i < described<T>::count, "member is not described");
+			return read<typename member_of<decltype(Member)>::type>(i);
+		}
+
+		// copies the datagram into a "T", e.g. to keep it past the buffer
+		T copy() const
+		{
+			T value {};
+			described<T>::each(value, [this]<class F>(F& member, size_t i) {
+				auto field {read<F>(i)};
+				if constexpr (flat_field<F>::variable) {
+					member.assign(field.begin(), field.end());
+				} else {
+					member = field;
+				}
+			});
+			return value;
+		}
+
+		std::span<const std::byte> bytes() const
+		{
+			return datagram_;
+		}
+
+	private:
+		template <class F>
+		typename flat_field<F>::view_t read(size_t i) const
+		{
+			auto data {datagram_.data()};
+			if constexpr (flat_field<F>::variable) {
+				using E = typename flat_field<F>::element_t;
+				return {reinterpret_cast<const E*>(data + starts_[i]), lengths_[i]};
+			} else {
+				F value;
+				std::memcpy(&value, data + described<T>::offset(i), sizeof(F));
+				return value;
+			}
+		}
+
+		// finds where each variable member starts, checks every one lies in the datagram
+		bool index()
+		{
+			if (datagram_.size() < described<T>::fixed) {
+				return false;
+			}
+
+			auto data {datagram_.data()};
+			size_t tail {described<T>::fixed};
+			bool fits {true};
+			described<T>::visit([&]<class F>(std::type_identity<F>, size_t i) {
+				if constexpr (flat_field<F>::variable) {
+					using E = typename flat_field<F>::element_t;
+					std::memcpy(&lengths_[i], data + described<T>::offset(i), sizeof(uint16_t));
+					starts_[i] = flat_align(tail, alignof(E));
+					tail = starts_[i] + lengths_[i] * sizeof(E);
+					fits = fits && reinterpret_cast<uintptr_t>(data + starts_[i]) % alignof(E) == 0;
+				}
+			});
+			return fits && tail <= datagram_.size();
+		}
+
+		buffer_t buffer_ {};
+		std::span<const std::byte> datagram_ {};
+		std::array<size_t, described<T>::count> starts_ {};
+		std::array<uint16_t, described<T>::count> lengths_ {};
+		bool valid_ {false};
+	};
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __BLUEGRASS_FRAMING__
+#define __BLUEGRASS_FRAMING__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "bluegrass/buffer_pool.hpp"
+#include "bluegrass/socket.hpp"
+
+namespace bluegrass {
+
+	// bounds of a "framer"
+	struct framing_t {
+		size_t mtu {0}; // datagram size, 0 takes the link MTU or 672 bytes
+		size_t max_message {64 * 1024}; // larger messages are refused and dropped
+		size_t max_pending {8}; // messages reassembled at once, the oldest is dropped past it
+		std::chrono::milliseconds timeout {2000}; // incomplete messages are dropped after it
+	};
+
+	// header of every fragment, followed by its bytes of the message
+	struct fragment_t {
+		uint32_t size; // bytes of the whole message
+		uint32_t offset; // position of this fragment in the message
+		uint16_t message; // id of the message on its connection
+		uint16_t reserved;
+	};
+
+	/*
+	 * "framer" sends messages of up to "max_message" bytes over a socket as
+	 * datagrams of at most "mtu" bytes and reassembles them on the other side.
+	 * Fragments of different messages may interleave, e.g. from several
+	 * sending threads; each message is delivered once all its bytes arrived.
+	 * Reassembly keeps at most "max_pending" messages in pooled buffers.
+	 * "send" is thread-safe. "receive" and "feed" take the input of one
+	 * connection and must not run concurrently.
+	 */
+	class framer {
+	public:
+		explicit framer(socket const&, framing_t const& ={});
+
+		framer(framer const&) = delete;
+		framer& operator=(framer const&) = delete;
+
+		/*
+		 * "send" fragments "message" and sends the fragments in order. While the
+		 * socket is full it waits up to "timeout" for room, then gives up.
+		 */
+		bool send(std::span<const std::byte> message);
+
+		// receives datagrams until a message is complete, empty on error
+		buffer_t receive();
+
+		// reassembles one received datagram, returns the message it completed if any
+		buffer_t feed(std::span<const std::byte> datagram);
+
+		// messages dropped as incomplete, oversized or malformed
+		size_t dropped() const
+		{
+			return dropped_;
+		}
+
+	private:
+		struct partial_t {
+			uint16_t message;
+			size_t received;
+			std::chrono::steady_clock::time_point started;
+			buffer_t buffer;
+		};
+
+		// drops the messages past "timeout"
+		void expire(std::chrono::steady_clock::time_point now);
+
+		socket const& conn_;
+		framing_t const limits_;
+		size_t mtu_;
+
+		std::atomic<uint16_t> next_ {0};
+		std::vector<partial_t> pending_;
+		buffer_t scratch_;
+		size_t dropped_ {0};
+	};
+
+} // namespace bluegrass
+
+#endif
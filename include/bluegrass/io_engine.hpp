@@ -0,0 +1,165 @@
+#ifndef __BLUEGRASS_IO_ENGINE__
+#define __BLUEGRASS_IO_ENGINE__
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "bluegrass/reactor.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * "io_op_t" is one socket operation of a batch. "flags" are MSG_* flags.
+	 * "buffer" is the index of the registered buffer holding "data", or -1.
+	 * After the batch "result" holds the bytes moved, or -errno.
+	 */
+	struct io_op_t {
+		int fd {-1};
+		void* data {nullptr};
+		size_t size {0};
+		int flags {0};
+		int buffer {-1};
+		ssize_t result {0};
+	};
+
+	// io_uring submission and completion rings, only defined when built with IO_URING
+	struct uring_t;
+
+	/*
+	 * "io_engine" performs batches of socket operations. When bluegrass is built
+	 * with IO_URING and the kernel allows io_uring, a batch is submitted to a ring
+	 * and completes in one kernel transition; otherwise every operation is its own
+	 * syscall. Results are the same on both paths. Operations on blocking sockets
+	 * block the batch until they complete, as the syscalls would.
+	 * Engines are per thread: "local" returns the engine of the calling thread.
+	 */
+	class io_engine {
+	public:
+		static io_engine& local()
+		{
+			thread_local io_engine engine_ {};
+			return engine_;
+		}
+
+		io_engine();
+
+		io_engine(io_engine const&) = delete;
+		io_engine(io_engine&&) = delete;
+		io_engine& operator=(io_engine const&) = delete;
+		io_engine& operator=(io_engine&&) = delete;
+
+		~io_engine();
+
+		// true if batches go through io_uring
+		bool uring() const;
+
+		/*
+		 * "buffers" registers memory with the ring of this engine, replacing
+		 * earlier registrations. Operations naming a registered buffer skip
+		 * pinning their pages per call; they ignore "flags".
+		 */
+		bool buffers(iovec const*, size_t);
+
+		// returns the number of operations which succeeded
+		size_t receive(io_op_t*, size_t);
+		size_t send(io_op_t*, size_t);
+
+	private:
+		size_t submit(io_op_t*, size_t, bool sending);
+
+		std::unique_ptr<uring_t> ring_;
+	};
+
+	/*
+	 * "acceptor" accepts connections with io_uring multishot accept: one submission
+	 * per listening socket keeps accepting, and completions are reaped on a reactor
+	 * thread through an eventfd. Without io_uring, or on kernels before multishot
+	 * accept, "available" is false and listening sockets are bound to the reactor.
+	 * A listener the ring cannot keep accepting for is handed to the reactor too.
+	 */
+	class acceptor : private reactor::binding_t {
+	public:
+		// owner of a listening socket
+		struct listener_t {
+			// runs on a reactor thread with every accepted client
+			virtual void accepted(int client) = 0;
+
+			// hands off the clients accepted during one wakeup
+			void (*flush)() {nullptr};
+
+			// accepts on the reactor instead if the ring gives the listening socket up
+			reactor::binding_t* fallback {nullptr};
+
+		protected:
+			~listener_t() = default;
+		};
+
+		// "acceptor" singleton accessor function
+		static acceptor& access()
+		{
+			static acceptor acceptor_;
+			return acceptor_;
+		}
+
+		acceptor(acceptor const&) = delete;
+		acceptor(acceptor&&) = delete;
+		acceptor& operator=(acceptor const&) = delete;
+		acceptor& operator=(acceptor&&) = delete;
+
+		~acceptor();
+
+		bool available() const;
+
+		// starts accepting on the listening socket "fd", false if unavailable
+		bool listen(int fd, listener_t&);
+
+		// stops accepting on "fd": "listener" is not called once this returns
+		void forget(int fd);
+
+	private:
+		enum class state_t : uint8_t {
+			ARMED,
+			PENDING, // given up by the ring, waiting to be bound to the reactor
+			BINDING, // being bound to the reactor
+		};
+
+		struct entry_t {
+			int fd;
+			listener_t* listener;
+			state_t state {state_t::ARMED};
+		};
+
+		acceptor();
+
+		// reaps accept completions and re-arms finished multishot accepts
+		void ready(int) override;
+
+		// hands off accepted clients and binds given up listeners to the reactor, runs unlocked
+		static void dispatch();
+
+		// submits a multishot accept for "fd" tagged with "id", requires "m_"
+		bool arm(int fd, uint64_t id);
+
+		// binds the listener "id" to the reactor unless it was forgotten meanwhile
+		void handover(uint64_t id);
+
+		std::unique_ptr<uring_t> ring_;
+		int event_ {-1};
+		std::mutex m_;
+		std::condition_variable handed_;
+		std::unordered_map<uint64_t, entry_t> listeners_;
+		uint64_t next_ {1};
+
+		inline static thread_local std::vector<void (*)()> flushes_ {};
+		inline static thread_local std::vector<uint64_t> handovers_ {};
+	};
+
+} // namespace bluegrass
+
+#endif
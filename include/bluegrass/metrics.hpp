@@ -0,0 +1,184 @@
+#ifndef __BLUEGRASS_METRICS__
+#define __BLUEGRASS_METRICS__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+namespace bluegrass {
+
+	/*
+	 * "histogram_t" is a latency histogram with power of two buckets: bucket i
+	 * counts samples in [2^i, 2^(i+1)) nanoseconds, bucket 0 also holds zero.
+	 */
+	struct histogram_t {
+		static constexpr size_t BUCKETS {40};
+
+		std::array<uint64_t, BUCKETS> counts {};
+
+		uint64_t total() const
+		{
+			uint64_t sum {0};
+			for (auto count : counts) {
+				sum += count;
+			}
+			return sum;
+		}
+
+		// upper bound of the bucket holding the "p" quantile (0 < p <= 1)
+		std::chrono::nanoseconds percentile(double p) const
+		{
+			auto rank {static_cast<uint64_t>(p * total())};
+			uint64_t seen {0};
+			for (size_t i {0}; i < BUCKETS; ++i) {
+				seen += counts[i];
+				if (seen && seen >= rank) {
+					return std::chrono::nanoseconds {int64_t {1} << (i + 1)};
+				}
+			}
+			return std::chrono::nanoseconds {0};
+		}
+	};
+
+	/*
+	 * "metrics_t" is a snapshot of a service:
+	 *	depth - elements queued at the time of the snapshot
+	 *	peak - highest depth observed after an enqueue
+	 *	enqueued, dequeued - elements which entered and left the queue
+	 *	dropped - elements refused because the service was shutdown
+	 *	unstamped - dequeued elements left out of "wait": their stamp was reused
+	 *	wait - time elements spent between enqueue and dequeue
+	 *	run - time the service routine spent per call
+	 */
+	struct metrics_t {
+		size_t depth {0}, peak {0};
+		uint64_t enqueued {0}, dequeued {0}, dropped {0}, unstamped {0};
+		histogram_t wait {}, run {};
+	};
+
+#ifdef SERVICE_METRICS
+	/*
+	 * "probe" collects the metrics of one service with relaxed atomic counters.
+	 * Wait times are matched by ticket: each enqueued element stamps the next
+	 * slot of a ring of timestamps and each dequeued element reads the oldest
+	 * unread slot. This is exact for a single producer on a FIFO backend while
+	 * at most "STAMPS" (1024) elements are queued, and approximate when
+	 * producers race or the backend reorders elements. An element dequeued after
+	 * "STAMPS" later elements were stamped lost its stamp: it counts as unstamped.
+	 */
+	class probe {
+	public:
+		using clock = std::chrono::steady_clock;
+		using stamp = clock::time_point;
+
+		static stamp now()
+		{
+			return clock::now();
+		}
+
+		// stamps the tickets of "count" elements about to be enqueued
+		void enqueue(size_t count)
+		{
+			auto when {since(now())};
+			size_t ticket {enq_.fetch_add(count, std::memory_order_relaxed)};
+			for (size_t i {0}; i < count; ++i) {
+				stamps_[(ticket + i) & MASK].store(when, std::memory_order_relaxed);
+			}
+		}
+
+		// accounts for an enqueue which landed "pushed" of "count" elements
+		template <class D>
+		void enqueued(size_t pushed, size_t count, D depth)
+		{
+			enqueued_.fetch_add(pushed, std::memory_order_relaxed);
+			dropped_.fetch_add(count - pushed, std::memory_order_relaxed);
+
+			size_t current {depth()}, peak {peak_.load(std::memory_order_relaxed)};
+			while (current > peak && !peak_.compare_exchange_weak(peak, current, std::memory_order_relaxed));
+		}
+
+		void dequeued(size_t count)
+		{
+			auto when {since(now())};
+			size_t ticket {deq_.fetch_add(count, std::memory_order_relaxed)};
+			size_t issued {enq_.load(std::memory_order_relaxed)};
+			for (size_t i {0}; i < count; ++i) {
+				if (ticket + i + STAMPS < issued) {
+					unstamped_.fetch_add(1, std::memory_order_relaxed);
+				} else {
+					record(wait_, when - stamps_[(ticket + i) & MASK].load(std::memory_order_relaxed));
+				}
+			}
+			dequeued_.fetch_add(count, std::memory_order_relaxed);
+		}
+
+		// records the routine run time of a call which started at "start"
+		void ran(stamp start)
+		{
+			record(run_, since(now()) - since(start));
+		}
+
+		metrics_t snapshot(size_t depth) const
+		{
+			metrics_t m {};
+			m.depth = depth;
+			m.peak = peak_.load(std::memory_order_relaxed);
+			m.enqueued = enqueued_.load(std::memory_order_relaxed);
+			m.dequeued = dequeued_.load(std::memory_order_relaxed);
+			m.dropped = dropped_.load(std::memory_order_relaxed);
+			m.unstamped = unstamped_.load(std::memory_order_relaxed);
+			for (size_t i {0}; i < histogram_t::BUCKETS; ++i) {
+				m.wait.counts[i] = wait_[i].load(std::memory_order_relaxed);
+				m.run.counts[i] = run_[i].load(std::memory_order_relaxed);
+			}
+			return m;
+		}
+
+	private:
+		static constexpr size_t STAMPS {1024};
+		static constexpr size_t MASK {STAMPS - 1};
+
+		using buckets = std::array<std::atomic<uint64_t>, histogram_t::BUCKETS>;
+
+		int64_t since(stamp when) const
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(when - epoch_).count();
+		}
+
+		static void record(buckets& histogram, int64_t nanos)
+		{
+			auto n {static_cast<unsigned long long>(nanos > 0 ? nanos : 0)};
+			size_t bucket {n ? static_cast<size_t>(63 - __builtin_clzll(n)) : 0};
+			histogram[std::min(bucket, histogram_t::BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		stamp const epoch_ {now()};
+		alignas(64) std::atomic<size_t> enq_ {0};
+		alignas(64) std::atomic<size_t> deq_ {0};
+		std::array<std::atomic<int64_t>, STAMPS> stamps_ {};
+		std::atomic<uint64_t> enqueued_ {0}, dequeued_ {0}, dropped_ {0}, unstamped_ {0};
+		std::atomic<size_t> peak_ {0};
+		buckets wait_ {}, run_ {};
+	};
+#else
+	// disabled "probe": every hook is empty and inlines to nothing
+	class probe {
+	public:
+		struct stamp {};
+
+		static stamp now() { return {}; }
+		void enqueue(size_t) {}
+		template <class D>
+		void enqueued(size_t, size_t, D) {}
+		void dequeued(size_t) {}
+		void ran(stamp) {}
+		metrics_t snapshot(size_t) const { return {}; }
+	};
+#endif
+
+} // namespace bluegrass
+
+#endif
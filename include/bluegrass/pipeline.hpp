@@ -0,0 +1,156 @@
+#ifndef __BLUEGRASS_PIPELINE__
+#define __BLUEGRASS_PIPELINE__
+
+#include <deque>
+#include <memory>
+#include <type_traits>
+
+#include "bluegrass/service.hpp"
+
+namespace bluegrass {
+
+	// capacity of the bounded ring between two pipeline stages
+	static constexpr size_t LINK_CAPACITY {64};
+
+	template <class T>
+	using link_t = ring_queue<T, LINK_CAPACITY>;
+
+	/*
+	 * "pipeline" owns a chain of services built with "source", "stage", and "sink":
+	 *
+	 *	auto p {source<raw_t>(decode, 1) | stage<raw_t, msg_t>(route, 2) | sink<msg_t>(dispatch, 4)};
+	 *
+	 * Every stage keeps its own thread count. Elements move from stage to stage
+	 * through bounded lock-free links: the threads of a stage dequeue from the
+	 * link behind them and enqueue into the link ahead of them, so no element
+	 * passes through the programmer's thread. The source and the first stage
+	 * share a NOQUEUE service; every later link is an ENQUEUE service.
+	 * A stage routine of the form "bool(T&, U&)" filters: the output element is
+	 * only forwarded when the routine returns true.
+	 * At shutdown (or destruction) stages are closed from the source to the sink,
+	 * so every element already in the pipeline is drained through to the sink.
+	 */
+	class pipeline {
+	public:
+		using stages = std::deque<std::shared_ptr<void>>;
+
+		explicit pipeline(stages&& s) : stages_ {std::move(s)} {}
+
+		pipeline(pipeline const&) = delete;
+		pipeline(pipeline&&) = default;
+		pipeline& operator=(pipeline const&) = delete;
+		pipeline& operator=(pipeline&&) = delete;
+
+		~pipeline()
+		{
+			shutdown();
+		}
+
+		// closes and drains the stages in order: a stage is joined before the next closes
+		void shutdown()
+		{
+			while (!stages_.empty()) {
+				stages_.pop_front();
+			}
+		}
+
+	private:
+		stages stages_;
+	};
+
+	/*
+	 * "chain" is a partially built pipeline whose last stage produces T. It holds
+	 * a builder which, given the routine consuming T and that routine's threads,
+	 * creates the services from the tail back to the source. Builders are typed
+	 * lambdas, so every forwarding routine is a concrete type the services inline.
+	 */
+	template <class T, class Build>
+	class chain {
+	public:
+		explicit chain(Build build) : build_ {std::move(build)} {}
+
+		template <class C>
+		void build(pipeline::stages& stages, C consume, threads_t const& consumers) const
+		{
+			build_(stages, std::move(consume), consumers);
+		}
+
+	private:
+		Build build_;
+	};
+
+	// stage description: a routine turning T into U, run on "threads"
+	template <class T, class U, class F>
+	struct stage_t {
+		F routine;
+		threads_t threads;
+	};
+
+	// sink description: a routine consuming T, run on "threads"
+	template <class T, class F>
+	struct sink_t {
+		F routine;
+		threads_t threads;
+	};
+
+	// "source" starts a pipeline: "threads" threads repeatedly call routine(T&) to create elements
+	template <class T, class F>
+	auto source(F routine, size_t threads = 1)
+	{
+		auto build {[routine, threads](pipeline::stages& stages, auto consume, threads_t const& consumers) {
+			stages.push_front(std::make_shared<service<T, NOQUEUE, link_t<T>>>(
+				routine, std::move(consume), threads, consumers));
+		}};
+		return chain<T, decltype(build)> {std::move(build)};
+	}
+
+	// "stage" describes a routine(T&, U&) which fills U from T
+	template <class T, class U, class F>
+	stage_t<T, U, F> stage(F routine, threads_t const& threads = 1)
+	{
+		return {std::move(routine), threads};
+	}
+
+	// "sink" ends a pipeline with a routine(T&)
+	template <class T, class F>
+	sink_t<T, F> sink(F routine, threads_t const& threads = 1)
+	{
+		return {std::move(routine), threads};
+	}
+
+	template <class T, class U, class Build, class F>
+	auto operator|(chain<T, Build> up, stage_t<T, U, F> st)
+	{
+		auto build {[up = std::move(up), st = std::move(st)](
+			pipeline::stages& stages, auto consume, threads_t const& consumers) {
+			auto link {std::make_shared<service<U, ENQUEUE, link_t<U>>>(std::move(consume), consumers)};
+			auto* next {link.get()};
+			stages.push_front(std::move(link));
+
+			// the stage runs on the threads dequeuing the link behind it
+			up.build(stages, [next, routine = st.routine](T& in) mutable {
+				U out {};
+				if constexpr (std::is_same_v<std::invoke_result_t<F&, T&, U&>, bool>) {
+					if (routine(in, out)) {
+						next->enqueue(out);
+					}
+				} else {
+					routine(in, out);
+					next->enqueue(out);
+				}
+			}, st.threads);
+		}};
+		return chain<U, decltype(build)> {std::move(build)};
+	}
+
+	template <class T, class Build, class F>
+	pipeline operator|(chain<T, Build> up, sink_t<T, F> sk)
+	{
+		pipeline::stages stages;
+		up.build(stages, std::move(sk.routine), sk.threads);
+		return pipeline {std::move(stages)};
+	}
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,471 @@
+#ifndef __BLUEGRASS_QUEUE__
+#define __BLUEGRASS_QUEUE__
+
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <queue>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace bluegrass {
+
+	// size of a cache line, used to keep contended atomics on separate lines
+	static constexpr size_t CACHE_LINE {64};
+
+	/*
+	 * The classes in this file are queue backends for "service". A backend is
+	 * internally synchronized and exposes a non-blocking interface:
+	 *	push - moves the element into the queue, returns false if the queue is full
+	 *	pop - moves the front element out of the queue, returns false if empty
+	 *	push (bulk) - moves up to count elements in, returns the number moved
+	 *	pop (bulk) - moves up to max elements out, returns the number moved
+	 *	empty - returns whether the queue holds no elements
+	 *	size - returns the number of held elements (approximate while contended)
+	 * Blocking, wakeups, and shutdown are handled by "service" itself.
+	 * Backends which keep per-thread lanes additionally expose:
+	 *	reserve - sizes the lane table, called once before any thread attaches
+	 *	attach - binds the calling service thread to a lane
+	 * Backends with priority levels additionally expose:
+	 *	LEVELS - the number of levels, level 0 being served first
+	 *	push (level) - moves up to count elements into the given level
+	 */
+
+	// detects backends with per-thread lanes so "service" can attach its threads
+	template <class B, class = void>
+	struct has_lanes : std::false_type {};
+
+	template <class B>
+	struct has_lanes<B, std::void_t<decltype(std::declval<B&>().attach(size_t {}))>> : std::true_type {};
+
+	// detects backends with priority levels so "service" can expose prioritized enqueues
+	template <class B, class = void>
+	struct has_levels : std::false_type {};
+
+	template <class B>
+	struct has_levels<B, std::void_t<decltype(B::LEVELS)>> : std::true_type {};
+
+	/*
+	 * "locked_queue" is an unbounded queue guarded by a single mutex. It is the
+	 * default backend of "service" and never reports itself full.
+	 */
+	template <class T>
+	class locked_queue {
+	public:
+		bool push(T& element)
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			queue_.push(std::move(element));
+			return true;
+		}
+
+		bool pop(T& element)
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			if (queue_.empty()) {
+				return false;
+			}
+
+			element = std::move(queue_.front());
+			queue_.pop();
+			return true;
+		}
+
+		size_t push(T* elements, size_t count)
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			for (size_t i {0}; i < count; ++i) {
+				queue_.push(std::move(elements[i]));
+			}
+			return count;
+		}
+
+		size_t pop(T* elements, size_t max)
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			size_t count {0};
+			for (; count < max && !queue_.empty(); ++count) {
+				elements[count] = std::move(queue_.front());
+				queue_.pop();
+			}
+			return count;
+		}
+
+		bool empty() const
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			return queue_.empty();
+		}
+
+		size_t size() const
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			return queue_.size();
+		}
+
+	private:
+		mutable std::mutex m_;
+		std::queue<T> queue_;
+	};
+
+	/*
+	 * "ring_queue" is a bounded lock-free multi-producer/multi-consumer ring buffer
+	 * holding at most N elements. N must be a power of two. Elements are stored in
+	 * place, so no allocation happens after construction. Every cell carries a
+	 * sequence number which tells producers and consumers whether the cell is free
+	 * for the current lap of the ring, so the only contended writes are a single
+	 * compare-exchange on the head or tail index.
+	 */
+	template <class T, size_t N = 256>
+	class ring_queue {
+		static_assert(N >= 2 && !(N & (N - 1)), "ring_queue capacity must be a power of two");
+	public:
+		ring_queue()
+		{
+			for (size_t i {0}; i < N; ++i) {
+				cells_[i].seq.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		ring_queue(ring_queue const&) = delete;
+		ring_queue(ring_queue&&) = delete;
+		ring_queue& operator=(ring_queue const&) = delete;
+		ring_queue& operator=(ring_queue&&) = delete;
+
+		bool push(T& element)
+		{
+			size_t pos {tail_.load(std::memory_order_relaxed)};
+
+			for (;;) {
+				cell& c {cells_[pos & MASK]};
+				auto diff {static_cast<intptr_t>(c.seq.load(std::memory_order_acquire) - pos)};
+
+				if (!diff) {
+					// cell is free for this lap: claim it by advancing the tail
+					if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						c.data = std::move(element);
+						c.seq.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					// cell still holds an element from the previous lap: ring is full
+					return false;
+				} else {
+					pos = tail_.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool pop(T& element)
+		{
+			size_t pos {head_.load(std::memory_order_relaxed)};
+
+			for (;;) {
+				cell& c {cells_[pos & MASK]};
+				auto diff {static_cast<intptr_t>(c.seq.load(std::memory_order_acquire) - (pos + 1))};
+
+				if (!diff) {
+					// cell was filled for this lap: claim it by advancing the head
+					if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						element = std::move(c.data);
+						c.seq.store(pos + N, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					// cell has not been filled yet: ring is empty
+					return false;
+				} else {
+					pos = head_.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		size_t push(T* elements, size_t count)
+		{
+			size_t pushed {0};
+			while (pushed < count && push(elements[pushed])) {
+				++pushed;
+			}
+			return pushed;
+		}
+
+		size_t pop(T* elements, size_t max)
+		{
+			size_t popped {0};
+			while (popped < max && pop(elements[popped])) {
+				++popped;
+			}
+			return popped;
+		}
+
+		bool empty() const
+		{
+			return !size();
+		}
+
+		size_t size() const
+		{
+			size_t head {head_.load(std::memory_order_acquire)};
+			size_t tail {tail_.load(std::memory_order_acquire)};
+			return tail > head ? tail - head : 0;
+		}
+
+		static constexpr size_t capacity()
+		{
+			return N;
+		}
+
+	private:
+		static constexpr size_t MASK {N - 1};
+
+		struct cell {
+			std::atomic<size_t> seq;
+			T data;
+		};
+
+		alignas(CACHE_LINE) std::array<cell, N> cells_;
+		alignas(CACHE_LINE) std::atomic<size_t> head_ {0};
+		alignas(CACHE_LINE) std::atomic<size_t> tail_ {0};
+	};
+
+	/*
+	 * "steal_queue" is an unbounded work-stealing queue. Every attached service 
+	 * thread owns a lane (a mutex guarded deque). An attached thread pushes to 
+	 * and pops from the front of its own lane, so work stays with the thread 
+	 * which produced it. A thread whose lane is empty steals from the back of 
+	 * the other lanes, taking its share plus half of the victim's remaining 
+	 * elements into its own lane. Threads which are not attached (for example 
+	 * the programmer's thread enqueueing into an ENQUEUE service) spread their 
+	 * pushes across the lanes round-robin.
+	 */
+	template <class T>
+	class steal_queue {
+	public:
+		void reserve(size_t lanes)
+		{
+			lanes_ = std::make_unique<lane[]>(lanes);
+			count_ = lanes;
+		}
+
+		void attach(size_t index)
+		{
+			self_ = {this, index % count_};
+		}
+
+		bool push(T& element)
+		{
+			return push(&element, 1);
+		}
+
+		bool pop(T& element)
+		{
+			return pop(&element, 1);
+		}
+
+		size_t push(T* elements, size_t count)
+		{
+			lane& own {lanes_[attached() ? self_.index : next_++ % count_]};
+			std::unique_lock<std::mutex> lock {own.m};
+			for (size_t i {0}; i < count; ++i) {
+				own.deque.push_back(std::move(elements[i]));
+			}
+			return count;
+		}
+
+		size_t pop(T* elements, size_t max)
+		{
+			bool local {attached()};
+			size_t index {local ? self_.index : next_++ % count_};
+			size_t popped {0};
+
+			if (local) {
+				lane& own {lanes_[index]};
+				std::unique_lock<std::mutex> lock {own.m};
+				for (; popped < max && !own.deque.empty(); ++popped) {
+					elements[popped] = std::move(own.deque.front());
+					own.deque.pop_front();
+				}
+			}
+
+			for (size_t i {local ? 1u : 0u}; !popped && i < count_; ++i) {
+				popped = steal((index + i) % count_, local ? &lanes_[index] : nullptr, elements, max);
+			}
+
+			return popped;
+		}
+
+		bool empty() const
+		{
+			return !size();
+		}
+
+		size_t size() const
+		{
+			size_t total {0};
+			for (size_t i {0}; i < count_; ++i) {
+				std::unique_lock<std::mutex> lock {lanes_[i].m};
+				total += lanes_[i].deque.size();
+			}
+			return total;
+		}
+
+	private:
+		struct lane {
+			alignas(CACHE_LINE) mutable std::mutex m;
+			std::deque<T> deque;
+		};
+
+		// identifies the lane of the calling thread, scoped to the owning queue
+		struct thread_lane {
+			steal_queue const* owner;
+			size_t index;
+		};
+
+		inline bool attached() const
+		{
+			return self_.owner == this;
+		}
+
+		// takes elements from the back of the victim lane, migrating half the rest to the thief
+		size_t steal(size_t index, lane* thief, T* elements, size_t max)
+		{
+			lane& victim {lanes_[index]};
+			std::unique_lock<std::mutex> vlock {victim.m, std::defer_lock};
+			std::unique_lock<std::mutex> tlock;
+
+			if (thief) {
+				tlock = std::unique_lock<std::mutex> {thief->m, std::defer_lock};
+				std::lock(vlock, tlock);
+			} else {
+				vlock.lock();
+			}
+
+			size_t stolen {0};
+			for (; stolen < max && !victim.deque.empty(); ++stolen) {
+				elements[stolen] = std::move(victim.deque.back());
+				victim.deque.pop_back();
+			}
+
+			if (thief) {
+				for (size_t half {victim.deque.size() / 2}; half; --half) {
+					thief->deque.push_front(std::move(victim.deque.back()));
+					victim.deque.pop_back();
+				}
+			}
+
+			return stolen;
+		}
+
+		inline static thread_local thread_lane self_ {nullptr, 0};
+
+		std::unique_ptr<lane[]> lanes_ {std::make_unique<lane[]>(1)};
+		size_t count_ {1};
+		std::atomic<size_t> next_ {0};
+	};
+
+	/*
+	 * "level_queue" is a priority queue with L levels, each held in its own 
+	 * backend Q (a "locked_queue" by default, or a "ring_queue" to stay lock-free). 
+	 * Level 0 is served first and elements pushed without a level go to the 
+	 * lowest level. BURST sets the anti-starvation policy: once a level has been 
+	 * served BURST times in a row while a lower level was waiting, it yields one 
+	 * turn to the levels below it. A BURST of 0 is strict priority.
+	 */
+	template <class T, size_t L = 2, size_t BURST = 0, class Q = locked_queue<T>>
+	class level_queue {
+		static_assert(L >= 1, "level_queue needs at least one level");
+	public:
+		static constexpr size_t LEVELS {L};
+
+		bool push(T& element)
+		{
+			return levels_[L - 1].push(element);
+		}
+
+		bool pop(T& element)
+		{
+			if constexpr (BURST != 0) {
+				for (size_t level {0}; level < L; ++level) {
+					std::atomic<size_t>& streak {streaks_[level]};
+
+					if (streak.load(std::memory_order_relaxed) >= BURST && waiting(level + 1)) {
+						streak.store(0, std::memory_order_relaxed);
+						continue;
+					}
+
+					if (levels_[level].pop(element)) {
+						if (waiting(level + 1)) {
+							streak.fetch_add(1, std::memory_order_relaxed);
+						} else {
+							streak.store(0, std::memory_order_relaxed);
+						}
+						return true;
+					}
+				}
+			}
+
+			// strict pass: also catches a lower level emptied while a level yielded to it
+			for (auto& level : levels_) {
+				if (level.pop(element)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		size_t push(T* elements, size_t count)
+		{
+			return levels_[L - 1].push(elements, count);
+		}
+
+		size_t push(T* elements, size_t count, size_t level)
+		{
+			return levels_[level < L ? level : L - 1].push(elements, count);
+		}
+
+		size_t pop(T* elements, size_t max)
+		{
+			size_t popped {0};
+			while (popped < max && pop(elements[popped])) {
+				++popped;
+			}
+			return popped;
+		}
+
+		bool empty() const
+		{
+			return !waiting(0);
+		}
+
+		size_t size() const
+		{
+			size_t total {0};
+			for (auto const& level : levels_) {
+				total += level.size();
+			}
+			return total;
+		}
+
+	private:
+		// returns whether any level from "from" downwards holds elements
+		bool waiting(size_t from) const
+		{
+			for (; from < L; ++from) {
+				if (!levels_[from].empty()) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		std::array<Q, L> levels_;
+		std::array<std::atomic<size_t>, L> streaks_ {};
+	};
+
+} // namespace bluegrass
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef __BLUEGRASS_REACTOR__
+#define __BLUEGRASS_REACTOR__
+
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <errno.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bluegrass/coroutine.hpp"
+#include "bluegrass/service.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * "reactor" waits on registered file descriptors with epoll from one or more
+	 * I/O threads. A descriptor is registered in one of two ways:
+	 *	bound - every time new input arrives, or for an output binding every 
+	 *		time its send buffer drains, the reactor calls the binding's
+	 *		"ready" on an I/O thread. After each wakeup the reactor calls the
+	 *		"flush" of every binding it called, so work collected across all
+	 *		ready descriptors is handed off in one batch. A one-shot input 
+	 *		binding is called once, then not again until "rearm".
+	 *	watched - a coroutine operation which would block is parked until the
+	 *		descriptor is ready. The reactor then retries it and, once it no
+	 *		longer blocks, resumes the coroutine on the scheduler it suspended
+	 *		from. One read and one write may be parked on a descriptor at a time.
+	 * A descriptor is either bound or watched, never both.
+	 */
+	class reactor {
+	public:
+		// an operation parked until its descriptor is ready
+		struct waiter_t {
+			// retries the operation, false while it would still block
+			virtual bool attempt() = 0;
+
+			int fd {-1};
+			uint32_t events {0};
+			std::coroutine_handle<> handle {};
+			scheduler* sched {nullptr};
+
+		protected:
+			~waiter_t() = default;
+		};
+
+		// a descriptor owner notified of every input edge
+		struct binding_t {
+			// collects the work of a ready descriptor, runs with the reactor locked
+			virtual void ready(int fd) = 0;
+
+			// hands off the work collected during one wakeup, runs unlocked
+			void (*flush)() {nullptr};
+
+		protected:
+			~binding_t() = default;
+		};
+
+		// "reactor" singleton accessor function
+		static reactor& access()
+		{
+			static reactor reactor_ {settings()};
+			return reactor_;
+		}
+
+		// sets the I/O threads of the reactor: only effective before the first "access"
+		static void setup(threads_t const& threads)
+		{
+			settings() = threads;
+		}
+
+		reactor(reactor const&) = delete;
+		reactor(reactor&&) = delete;
+		reactor& operator=(reactor const&) = delete;
+		reactor& operator=(reactor&&) = delete;
+
+		~reactor();
+
+		// calls "binding" for every input edge on "fd" until "forget", false if epoll refused "fd"
+		bool bind(int fd, binding_t& binding, bool oneshot=false);
+
+		// reports input on the one-shot binding of "fd" again, at once if some is unread
+		void rearm(int fd);
+
+		/*
+		 * calls "binding" for every output edge on "fd", when room frees up in its 
+		 * send buffer, until "unbind_output" or "forget". It may be combined with "bind".
+		 */
+		void bind_output(int fd, binding_t& binding);
+
+		void unbind_output(int fd);
+
+		// parks "waiter" until its "fd" is readable (EPOLLIN) or writable (EPOLLOUT)
+		void watch(waiter_t& waiter);
+
+		/*
+		 * drops "fd" and any parked operations on it, which are never resumed. Once it 
+		 * returns no reactor thread is inside "ready" or a "flush", so the work a 
+		 * binding of "fd" collected has been handed off.
+		 */
+		void forget(int fd);
+
+	private:
+		struct entry_t {
+			binding_t* bound {nullptr};
+			binding_t* output {nullptr};
+			waiter_t* read {nullptr};
+			waiter_t* write {nullptr};
+			bool oneshot {false};
+			bool paused {false}; // a one-shot binding was called and not re-armed yet
+		};
+
+		// wakeups of one I/O thread, "flushing" while it flushes unlocked
+		struct pass_t {
+			uint64_t count {0};
+			bool flushing {false};
+		};
+
+		explicit reactor(threads_t const&);
+
+		static threads_t& settings()
+		{
+			static threads_t threads {1};
+			return threads;
+		}
+
+		// (re-)registers "fd" with the events its entry waits for, false if epoll refused it
+		bool arm(int fd, entry_t const&, bool added);
+
+		void run(size_t index);
+
+		threads_t const pool_;
+		int epoll_;
+		int wakeup_;
+		std::mutex m_;
+		std::condition_variable flushed_;
+		std::unordered_map<int, entry_t> fds_;
+		std::vector<pass_t> passes_;
+		std::vector<std::thread> threads_;
+
+		// index of the I/O thread calling, none on other threads
+		inline static thread_local size_t current_ {static_cast<size_t>(-1)};
+	};
+
+	/*
+	 * "io_awaiter" is the awaitable of one non-blocking operation "op" on a
+	 * descriptor. "op" returns a byte count, or -1 with errno set. The awaiter
+	 * completes immediately unless "op" fails with EAGAIN, in which case the
+	 * coroutine is parked on the reactor. It resumes with the result of "op".
+	 */
+	template <class Op>
+	class io_awaiter : public reactor::waiter_t {
+	public:
+		io_awaiter(int descriptor, uint32_t wanted, Op op) : op_ {std::move(op)}
+		{
+			fd = descriptor;
+			events = wanted;
+		}
+
+		bool await_ready()
+		{
+			return attempt();
+		}
+
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			handle = h;
+			sched = scheduler::current();
+			reactor::access().watch(*this);
+		}
+
+		ssize_t await_resume() const
+		{
+			return result_;
+		}
+
+		bool attempt() override
+		{
+			result_ = op_();
+			return result_ != -1 || (errno != EAGAIN && errno != EWOULDBLOCK);
+		}
+
+	private:
+		Op op_;
+		ssize_t result_ {-1};
+	};
+
+} // namespace bluegrass
+
+#endif
@@ -5,16 +5,25 @@
 #include <map>
 #include <set>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "bluegrass/bluetooth.hpp"
-#include "bluegrass/hci.hpp"
+#include "bluegrass/compression.hpp"
+#include "bluegrass/send_queue.hpp"
 #include "bluegrass/socket.hpp"
 
 namespace bluegrass {
 
 	class router {
 	public:
-		router(uint16_t, size_t=16, size_t=1);
+		/*
+		 * Compression is opt-in: with "compression.enabled" neighbors which enable it 
+		 * too agree on it while onboarding, and TRIGGER payloads of at least 
+		 * "threshold" bytes travel LZ compressed between them. Payloads leave the 
+		 * network uncompressed, whichever way they travelled.
+		 */
+		router(uint16_t, size_t=16, threads_t const& =1, compression_t const& ={.enabled = false});
 
 		// router is not copyable or movable: need stable references
 		router(router const&) = delete;
@@ -33,19 +42,43 @@ namespace bluegrass {
 
 		void suspend(uint8_t);
 
+		// sends a payload of up to 255 bytes to the device offering "service", only its own length goes on the air
+		bool trigger(uint8_t, std::span<const std::byte>);
+
 		template <class T, 
 		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
 		bool trigger(uint8_t service, T const& payload)
 		{
-			bool result {false};
-			auto route {routes_.find(service)};
+			return trigger(service, std::as_bytes(std::span {&payload, 1}));
+		}
+
+		// sends a type described in the flat wire format, its service receives it with "router::receive<T>"
+		template <class T, 
+		typename std::enable_if_t<is_described_v<T>, bool> = true>
+		bool trigger(uint8_t service, T const& payload)
+		{
+			auto buffer {buffer_pool::access().acquire(flat_size(payload))};
+			return flat_write(payload, buffer.span()) && trigger(service, std::as_bytes(buffer.span()));
+		}
 
-			if (available(route)) {
-				packet_t<T> packet {{utility_t::TRIGGER, service, sizeof(T)}, payload}; 
-				result = route->second.conn.send(&packet, sizeof(packet_t<T>));
+		/*
+		 * "receive<T>" is "socket::receive<T>" for a published service: the router 
+		 * header in front of the payload is scattered off, so the payload starts 
+		 * the pooled buffer as aligned as it was written. The view is false on 
+		 * error, a malformed datagram or one which is not a TRIGGER.
+		 */
+		template <class T, 
+		typename std::enable_if_t<is_described_v<T>, bool> = true>
+		static flat_view<T> receive(socket const& conn, int flags=0)
+		{
+			auto buffer {buffer_pool::access().acquire(UINT8_MAX)};
+			header_t info {};
+			ssize_t n {conn.receivev(&info, buffer.span(), flags | MSG_TRUNC)};
+			if (n < 0 || n != info.length || info.utility != utility_t::TRIGGER) {
+				return {};
 			}
-			
-			return result;
+			buffer.resize(n);
+			return flat_view<T> {std::move(buffer)};
 		}
 
 	private:
@@ -54,6 +87,7 @@ namespace bluegrass {
 			ONBOARD=13,
 			PUBLISH=17,
 			SUSPEND=19,
+			TRIGGER_LZ=23, // TRIGGER with an LZ compressed payload
 		};
 
 		// stores packet data used for routing
@@ -97,14 +131,28 @@ namespace bluegrass {
 
 		void suspend(network_t);
 
-		void onboard(socket const&, network_t);
+		void onboard(socket const&);
 
 		void trigger(socket const&, uint8_t, uint8_t);
 
+		/*
+		 * sends a TRIGGER along "route", compressed if its next hop decodes it and 
+		 * uncompressed otherwise. Toward a neighbor it queues behind packets still 
+		 * waiting for that neighbor, and is queued itself if the socket is full.
+		 */
+		bool deliver(service_t const& route, header_t, std::span<const std::byte>);
+
+		// codecs offered to neighbors while onboarding
+		uint8_t offered() const;
+
 		void connection(socket&);
 
+		// service level of a readable connection: TRIGGER payloads queue behind control messages
+		static size_t classify(socket const&);
+
 		bdaddr_t addr_;
 		uint16_t port_;
+		compression_t const compression_;
 
 		async_socket::service_handle service_;
 		async_socket server_;
@@ -112,8 +160,14 @@ namespace bluegrass {
 		std::set<async_socket, std::less<socket>> clients_;
 		std::map<uint8_t, service_t> routes_;
 
-		uint8_t length_;
-		std::unique_ptr<uint8_t*> buffer_;
+		// guards the per-neighbor state below, which service threads of the router share
+		std::mutex m_;
+
+		// neighbors which agreed on LZ compression while onboarding
+		std::set<async_socket const*> compressing_;
+
+		// neighbors whose socket was full, created on the first full send; destroyed before "clients_"
+		std::unordered_map<async_socket const*, send_queue> queues_;
 	};
 
 } // namespace bluegrass 
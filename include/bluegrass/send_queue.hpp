@@ -0,0 +1,103 @@
+#ifndef __BLUEGRASS_SEND_QUEUE__
+#define __BLUEGRASS_SEND_QUEUE__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <span>
+
+#include "bluegrass/buffer_pool.hpp"
+#include "bluegrass/reactor.hpp"
+#include "bluegrass/socket.hpp"
+
+namespace bluegrass {
+
+	// outcome of a "send_queue::send"
+	enum class sent_t : uint8_t {
+		SENT, // handed to the socket
+		QUEUED, // kept until the socket has room
+		CONGESTED, // refused: the queue is past its high watermark
+		FAILED, // refused: the connection failed
+	};
+
+	// bytes queued at which a "send_queue" starts and stops refusing datagrams
+	struct watermarks_t {
+		size_t high {64 * 1024};
+		size_t low {16 * 1024};
+	};
+
+	/*
+	 * "send_queue" sends datagrams on a socket without losing them to a full
+	 * send buffer. While the socket is full, or earlier datagrams still wait,
+	 * datagrams are copied into pooled buffers and queued; a reactor thread
+	 * sends them in order as soon as the socket has room again. Once "high"
+	 * bytes are queued the queue is congested and refuses new datagrams until
+	 * it has drained to "low", so producers see backpressure instead of loss:
+	 * they can check "congested" or block in "wait". A connection error fails
+	 * the queue for good and drops what it held.
+	 */
+	class send_queue : private reactor::binding_t {
+	public:
+		explicit send_queue(socket const&, watermarks_t const& ={});
+
+		send_queue(send_queue const&) = delete;
+		send_queue(send_queue&&) = delete;
+		send_queue& operator=(send_queue const&) = delete;
+		send_queue& operator=(send_queue&&) = delete;
+
+		// drops queued datagrams: the socket must outlive the queue
+		~send_queue();
+
+		sent_t send(std::span<const std::byte> datagram);
+
+		// gathers the buffers into one datagram like "socket::sendv", a queued datagram is copied whole
+		sent_t send(std::span<const iovec> buffers);
+
+		template <class T,
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		sent_t send(const T* data)
+		{
+			return send(std::as_bytes(std::span {data, 1}));
+		}
+
+		template <class H,
+		typename std::enable_if_t<std::is_trivial_v<H>, bool> = true>
+		sent_t send(const H* header, std::span<const std::byte> payload)
+		{
+			iovec buffers[2] {{(void*) header, sizeof(H)}, {(void*) payload.data(), payload.size()}};
+			return send(std::span<const iovec> {buffers});
+		}
+
+		// bytes waiting for room in the socket
+		size_t queued() const;
+
+		bool congested() const;
+
+		bool failed() const;
+
+		// blocks until the queue is no longer congested, false on timeout or failure
+		bool wait(std::chrono::milliseconds timeout);
+
+	private:
+		// sends queued datagrams while the socket has room, requires "m_"
+		void drain();
+
+		// runs on a reactor thread whenever the socket has room again
+		void ready(int) override;
+
+		socket const& conn_;
+		watermarks_t const marks_;
+
+		mutable std::mutex m_;
+		std::condition_variable relieved_;
+		std::deque<buffer_t> queue_;
+		size_t bytes_ {0};
+		bool congested_ {false};
+		bool failed_ {false};
+	};
+
+} // namespace bluegrass
+
+#endif
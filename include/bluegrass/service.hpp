@@ -1,14 +1,29 @@
 #ifndef __BLUEGRASS_SERVICE__
 #define __BLUEGRASS_SERVICE__
 
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
 #include <functional>
 #include <type_traits>
+#include <algorithm>
+#include <chrono>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
-#include <queue>
+#include <optional>
+#include <span>
 #include <vector>
 
+#include "bluegrass/coroutine.hpp"
+#include "bluegrass/metrics.hpp"
+#include "bluegrass/queue.hpp"
+
 namespace bluegrass {
 	
 	/*
@@ -25,11 +40,123 @@ namespace bluegrass {
 		DEQUEUE,
 		NOQUEUE,
 	};
+
+	/*
+	 * "wait_t" selects how a consumer waits on an empty service:
+	 *	BLOCK - parks on a condition variable right away
+	 *	SPIN - retries "spins" times with a pause, then "yields" times with a 
+	 *		yield, then parks: a producer skips the futex wake while consumers spin
+	 *	POLL - retries with a pause and never parks, dedicating the core
+	 */
+	enum class wait_t { 
+		BLOCK, 
+		SPIN, 
+		POLL,
+	};
+
+	// cpu hint that the caller is spinning
+	inline void relax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		asm volatile("yield");
+#endif
+	}
+
+	/*
+	 * "threads_t" describes the worker threads of a service. A plain thread count 
+	 * converts to a fixed pool of that size. Otherwise the service starts "min" 
+	 * workers and scales between "min" and "max":
+	 *	a worker spawns another worker when, after it dequeues, more than 
+	 *		"backlog" elements per running worker are still queued
+	 *	a worker above "min" retires after waiting "idle" without an element
+	 * Workers which produce elements (DEQUEUE services) only change in number 
+	 * through "service::resize".
+	 * 
+	 * "wait" with "spins" and "yields" is the wait policy of every consumer of 
+	 * the service (see wait_t). POLL workers do not retire on "idle".
+	 * 
+	 * The remaining fields place and schedule every thread of the service:
+	 *	cpus - cores the threads may run on, empty leaves placement to the kernel
+	 *	spread - pins thread i to the single core cpus[i % cpus.size()], or to 
+	 *		core i modulo the core count when "cpus" is empty
+	 *	policy, priority - scheduling policy (SCHED_OTHER, SCHED_FIFO, SCHED_RR) 
+	 *		and its static priority
+	 *	nice - nice level of the threads
+	 *	name - thread name prefix, the thread's slot number is appended
+	 * Settings are applied by each thread as it starts and are best effort: a 
+	 * setting the process lacks privileges for (SCHED_FIFO without CAP_SYS_NICE, 
+	 * a negative nice level) leaves that attribute at its default.
+	 */
+	struct threads_t {
+		threads_t(size_t count = 1) : min {count}, max {count} {}
+
+		threads_t(size_t low, size_t high) : min {low}, max {std::max(low, high)} {}
+
+		size_t min, max;
+		size_t backlog {4};
+		std::chrono::milliseconds idle {1000};
+
+		wait_t wait {wait_t::BLOCK};
+		size_t spins {512}, yields {8};
+
+		std::vector<int> cpus {};
+		bool spread {false};
+		int policy {SCHED_OTHER}, priority {0};
+		int nice {0};
+		std::string name {};
+
+		// applies the placement and scheduling settings to the calling thread
+		void configure(size_t index) const
+		{
+			if (!cpus.empty() || spread) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+
+				if (!spread) {
+					for (int cpu : cpus) {
+						CPU_SET(cpu, &set);
+					}
+				} else if (cpus.empty()) {
+					CPU_SET(index % std::max(std::thread::hardware_concurrency(), 1u), &set);
+				} else {
+					CPU_SET(cpus[index % cpus.size()], &set);
+				}
+
+				pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+			}
+
+			if (policy != SCHED_OTHER) {
+				sched_param param {};
+				param.sched_priority = priority;
+				pthread_setschedparam(pthread_self(), policy, &param);
+			}
+
+			// Linux nice levels are per thread when addressed by thread id
+			if (nice) {
+				setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), nice);
+			}
+
+			// names are limited to 15 characters by the kernel
+			if (!name.empty()) {
+				std::string label {name + std::to_string(index)};
+				pthread_setname_np(pthread_self(), label.substr(0, 15).c_str());
+			}
+		}
+	};
 	
 	/*
-	 * Class template "service" has two template parameters:
+	 * Class template "service" has three template parameters:
 	 *	 T - the service element type
 	 *	 Q - the queue type of the associated service
+	 *	 B - the queue backend (see queue.hpp), by default a mutex guarded
+	 *	     unbounded "locked_queue". Passing "ring_queue<T, N>" selects a 
+	 *	     bounded lock-free ring for contended multi-threaded services.
+	 *	     Passing "steal_queue<T>" gives every service thread its own lane 
+	 *	     and lets idle threads steal work from busy ones.
+	 *	     Passing "level_queue<T, L, BURST>" adds priority levels which the 
+	 *	     programmer selects per enqueue.
 	 * 
 	 * "service" provides asynchronous queuing functionality.
 	 * Programmer has access to either enqueue or dequeue while the internal
@@ -39,44 +166,55 @@ namespace bluegrass {
 	 * At shutdown, a service will process all remaining elements before 
 	 * joining service threads.
 	 */
-	template <class T, queue_t Q>
+	template <class T, queue_t Q, class B = locked_queue<T>>
 	class service {
 	public:
-		template <queue_t Q_TYPE = Q, 
-		typename std::enable_if_t<Q_TYPE != NOQUEUE, bool> = true>
-		service(std::function<void(T&)> routine, size_t thread_count) 
+		/*
+		 * Routines are taken by their own type "F" and stored in the service 
+		 * threads, so each thread loop is instantiated for the routine and 
+		 * lambdas are inlined into it. A std::function routine binds as before 
+		 * (F is then std::function) and the service type is unaffected by F.
+		 */
+		template <class F, queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE != NOQUEUE && std::is_invocable_v<F&, T&>, bool> = true>
+		service(F routine, threads_t const& threads) : pool_ {threads}
 		{		
-			// reserved vector will ensure stable threads
-			threads_.reserve(thread_count);
+			if constexpr (Q == DEQUEUE) {
+				worker_ = [this, routine](size_t slot) mutable { prepare(slot); create(routine, slot); };
+			} else {
+				worker_ = [this, routine](size_t slot) mutable { prepare(slot); utilize(routine, slot); };
+			}
 
-			while (threads_.size() < thread_count) {
-				if constexpr (Q == DEQUEUE) {
-					threads_.emplace_back(std::thread(
-					[this, routine] { enqueue(routine); }));
-				} else {
-					threads_.emplace_back(std::thread(
-					[this, routine] { dequeue(routine); }));
-				}
-			}	
+			start(0);
 		}
 		
-		// special NOQUEUE constructor
-		template <queue_t Q_TYPE = Q, 
+		/*
+		 * Batch ENQUEUE constructor: service threads dequeue up to "batch" elements 
+		 * at a time and hand them to "routine" as a span, so one queue round-trip 
+		 * and one wakeup covers the whole batch.
+		 */
+		template <class F, queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == ENQUEUE && std::is_invocable_v<F&, std::span<T>>, bool> = true>
+		service(F routine, threads_t const& threads, size_t batch) : pool_ {threads}
+		{
+			worker_ = [this, routine, batch](size_t slot) mutable { prepare(slot); utilize(routine, batch, slot); };
+			start(0);
+		}
+		
+		// special NOQUEUE constructor: only the dequeuing threads scale
+		template <class E, class D, queue_t Q_TYPE = Q, 
 		typename std::enable_if_t<Q_TYPE == NOQUEUE, bool> = true>
-		service(std::function<void(T&)> enq_routine, std::function<void(T&)> deq_routine,
-			size_t enq_threads, size_t deq_threads) 
+		service(E enq_routine, D deq_routine, size_t enq_threads, threads_t const& deq_threads) : 
+			pool_ {deq_threads}
 		{	
-			// reserved vector will ensure stable threads
-			threads_.reserve(enq_threads + deq_threads);
+			worker_ = [this, deq_routine](size_t slot) mutable { prepare(slot); utilize(deq_routine, slot); };
+			start(enq_threads);
 
-			for (; enq_threads; --enq_threads) {
+			// producers own lanes too: their elements stay local until stolen
+			while (threads_.size() < pool_.max + enq_threads) {
 				threads_.emplace_back(std::thread(
-				[this, enq_routine] { enqueue(enq_routine); }));
+				[this, enq_routine, slot = threads_.size()]() mutable { prepare(slot); create(enq_routine, slot); }));
 			}
-			for (; deq_threads; --deq_threads) {
-				threads_.emplace_back(std::thread(
-				[this, deq_routine] { dequeue(deq_routine); }));
-			}	
 		}
 		
 		// service is not copyable or movable: need stable references
@@ -89,12 +227,62 @@ namespace bluegrass {
 		~service() 
 		{
 			shutdown();
-			for (auto& t : threads_) {
+
+			// no thread is spawned once shut down, so the slots can be taken and joined
+			std::vector<std::thread> threads;
+			{
+				std::unique_lock<std::mutex> lock {pool_m_};
+				threads.swap(threads_);
+			}
+
+			for (auto& t : threads) {
 				if (t.joinable()) { 
 					t.join(); 
 				}
 			}
 		}
+
+		/*
+		 * "resize" sets the number of worker threads, clamped to the bounds the 
+		 * service was constructed with. Growing spawns the workers before returning. 
+		 * Shrinking retires workers as they finish the element they hold.
+		 */
+		void resize(size_t count)
+		{
+			count = std::clamp(count, pool_.min, pool_.max);
+			{
+				std::unique_lock<std::mutex> lock {pool_m_};
+				size_t current {active_ - surplus_};
+
+				if (count > current) {
+					// cancel pending retirements before spawning new workers
+					size_t cancel {std::min<size_t>(surplus_, count - current)};
+					surplus_ -= cancel;
+					spawn(count - current - cancel);
+				} else {
+					surplus_ += current - count;
+				}
+			}
+
+			std::unique_lock<std::mutex> lock {m_};
+			deqcv_.notify_all();
+		}
+
+		// returns the number of running worker threads
+		size_t workers() const
+		{
+			return active_ - surplus_;
+		}
+
+		/*
+		 * "metrics" returns a snapshot of the queue depth, element counts, and 
+		 * wait/run time histograms of the service. Collection is compiled in with 
+		 * SERVICE_METRICS, otherwise the hooks are empty and the snapshot is zeroed.
+		 */
+		metrics_t metrics() const
+		{
+			return probe_.snapshot(queue_.size());
+		}
 		
 		/*
 		 * "enqueue" is a blocking function. If the internal queue is full, 
@@ -106,37 +294,116 @@ namespace bluegrass {
 		typename std::enable_if_t<Q_TYPE == ENQUEUE, bool> = true>
 		bool enqueue(T& element) 
 		{
-			std::unique_lock<std::mutex> lock {m_};
+			return push(&element, 1);
+		}
 
-			if (open_) {
-				queue_.push(std::move(element));
-				deqcv_.notify_one();
-			}
-			
-			return open_;
+		/*
+		 * "enqueue_bulk" moves the elements of the span into the service and 
+		 * blocks while a bounded queue is full. It returns the number of elements 
+		 * enqueued, which is less than "elements.size()" only if the service 
+		 * was shutdown during the call.
+		 */
+		template <queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == ENQUEUE, bool> = true>
+		size_t enqueue_bulk(std::span<T> elements) 
+		{
+			return push(elements.data(), elements.size());
+		}
+
+		/*
+		 * Prioritized "enqueue" and "enqueue_bulk" for level backends. Service 
+		 * threads always drain lower numbered levels first, subject to the 
+		 * anti-starvation policy of the backend. Plain "enqueue" uses the 
+		 * lowest level.
+		 */
+		template <queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == ENQUEUE && has_levels<B>::value, bool> = true>
+		bool enqueue(T& element, size_t level) 
+		{
+			return push(&element, 1, level);
+		}
+
+		template <queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == ENQUEUE && has_levels<B>::value, bool> = true>
+		size_t enqueue_bulk(std::span<T> elements, size_t level) 
+		{
+			return push(elements.data(), elements.size(), level);
 		}
 		
 		/*
 		 * "dequeue" is a blocking function. If the internal queue is empty, 
 		 * the call will block. dequeue returns a bool representing whether 
-		 * the service is open or not. if the service is shutdown and empty 
+		 * an element was removed. If the service is shutdown and empty 
 		 * at the time of access, "dequeue" will fail to remove the element.
 		 */
 		template <queue_t Q_TYPE = Q, 
 		typename std::enable_if_t<Q_TYPE == DEQUEUE, bool> = true>
 		bool dequeue(T& element) 
 		{
-			std::unique_lock<std::mutex> lock {m_};
-			while (open_ && queue_.empty()) { 
-				deqcv_.wait(lock); 
+			return pop(&element, 1);
+		}
+
+		/*
+		 * "dequeue_bulk" moves up to "elements.size()" elements into the span. It 
+		 * blocks until at least one element is available and returns the number 
+		 * of elements removed. Zero is returned once the service is shutdown and empty.
+		 */
+		template <queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == DEQUEUE, bool> = true>
+		size_t dequeue_bulk(std::span<T> elements) 
+		{
+			return pop(elements.data(), elements.size());
+		}
+
+		/*
+		 * "dequeue" without arguments is the awaitable form for coroutines:
+		 *
+		 *	while (auto element {co_await svc.dequeue()}) { ... }
+		 *
+		 * The coroutine suspends without blocking its thread while the service is 
+		 * empty and is resumed on its scheduler once a producer hands it an element. 
+		 * It resumes with an empty optional once the service is shutdown and empty.
+		 */
+		class awaiter {
+		public:
+			explicit awaiter(service& svc) : svc_ {svc} {}
+
+			bool await_ready()
+			{
+				return svc_.claim(*this);
 			}
-			
-			if (!queue_.empty()) {
-				element = std::move(queue_.front());
-				queue_.pop();
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				handle_ = handle;
+				sched_ = scheduler::current();
+				return svc_.suspend(*this);
 			}
-			
-			return open_ || !queue_.empty();
+
+			std::optional<T> await_resume()
+			{
+				if (ok_) {
+					return std::optional<T> {std::move(element_)};
+				}
+				return std::nullopt;
+			}
+
+		private:
+			friend class service;
+
+			service& svc_;
+			T element_ {};
+			bool ok_ {false};
+			std::coroutine_handle<> handle_ {};
+			scheduler* sched_ {nullptr};
+			awaiter* next_ {nullptr};
+		};
+
+		template <queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == DEQUEUE, bool> = true>
+		awaiter dequeue() 
+		{
+			return awaiter {*this};
 		}
 		
 		/*
@@ -147,49 +414,134 @@ namespace bluegrass {
 		 */
 		void shutdown() 
 		{
-			std::unique_lock<std::mutex> lock {m_};
-			if (open_) {
-				open_ = false;
-				deqcv_.notify_all();
+			{
+				std::unique_lock<std::mutex> lock {m_};
+				if (open_) {
+					open_ = false;
+					deqcv_.notify_all();
+					enqcv_.notify_all();
+				}
 			}
+			handoff();
 		}
 		
 	private:
+		// marks a thread which is not a pool worker, or an enqueue without a level
+		static constexpr size_t FIXED {static_cast<size_t>(-1)};
+
 		// thread routine to utilize an element on the queue
-		template <queue_t Q_TYPE = Q, 
+		template <class F, queue_t Q_TYPE = Q, 
 		typename std::enable_if_t<Q_TYPE != DEQUEUE, bool> = true>
-		void dequeue(std::function<void(T&)> routine) 
+		void utilize(F& routine, size_t slot) 
 		{
 			T data;
-			while (dequeue(data)) { 
+			while (pop(&data, 1, slot)) { 
+				scale();
+				auto start {probe_.now()};
 				routine(data); 
+				probe_.ran(start);
+			}
+		}
+		
+		// thread routine to utilize a batch of elements on the queue
+		template <class F, queue_t Q_TYPE = Q, 
+		typename std::enable_if_t<Q_TYPE == ENQUEUE, bool> = true>
+		void utilize(F& routine, size_t batch, size_t slot) 
+		{
+			std::vector<T> data(batch);
+			size_t count;
+			while ((count = pop(data.data(), batch, slot))) { 
+				scale();
+				auto start {probe_.now()};
+				routine(std::span {data.data(), count}); 
+				probe_.ran(start);
 			}
 		}
 		
 		// thread routine to create an element for the queue
-		template <queue_t Q_TYPE = Q, 
+		template <class F, queue_t Q_TYPE = Q, 
 		typename std::enable_if_t<Q_TYPE != ENQUEUE, bool> = true>
-		void enqueue(std::function<void(T&)> routine) 
+		void create(F& routine, size_t slot) 
 		{
+			// producer pool workers only leave a running service through "resize"
+			bool pooled {Q == DEQUEUE && slot < pool_.max};
 			T data;
 			do { 
+				if (pooled && surplus_ && retire(slot, false)) {
+					return;
+				}
+				auto start {probe_.now()};
 				routine(data); 
+				probe_.ran(start);
 			} while (enqueue(data));
 		}
+
+		// sizes the thread slots and spawns the minimum number of workers
+		void start(size_t fixed)
+		{
+			// reserved vector will ensure stable threads
+			threads_.reserve(pool_.max + fixed);
+			threads_.resize(pool_.max);
+			live_.resize(pool_.max);
+			lanes(pool_.max + fixed);
+
+			std::unique_lock<std::mutex> lock {pool_m_};
+			spawn(pool_.min);
+		}
+
+		// spawns up to "count" workers into free slots: "pool_m_" must be held
+		void spawn(size_t count)
+		{
+			for (size_t slot {0}; count && slot < pool_.max && open_; ++slot) {
+				if (!live_[slot]) {
+					// a retired worker has already released its slot and is exiting
+					if (threads_[slot].joinable()) {
+						threads_[slot].join();
+					}
+
+					live_[slot] = true;
+					++active_;
+					--count;
+					threads_[slot] = std::thread(worker_, slot);
+				}
+			}
+		}
+
+		// releases the slot of the calling worker if it is idle above the minimum or in surplus
+		bool retire(size_t slot, bool idle)
+		{
+			std::unique_lock<std::mutex> lock {pool_m_};
+			if (surplus_) {
+				--surplus_;
+			} else if (!idle || active_ <= pool_.min) {
+				return false;
+			}
+
+			live_[slot] = false;
+			--active_;
+			return true;
+		}
+
+		// spawns another worker when the backlog per running worker exceeds the policy
+		inline void scale()
+		{
+			if (pool_.min < pool_.max) {
+				size_t active {active_};
+				if (active < pool_.max && queue_.size() > pool_.backlog * active) {
+					std::unique_lock<std::mutex> lock {pool_m_, std::try_to_lock};
+					if (lock) {
+						spawn(1);
+					}
+				}
+			}
+		}
 		
 		// Private redefinition of enqueue instantiated for DEQUEUE
 		template <queue_t Q_TYPE = Q, 
 		typename std::enable_if_t<Q_TYPE != ENQUEUE, bool> = true>
 		bool enqueue(T& element) 
 		{
-			std::unique_lock<std::mutex> lock {m_};
-			
-			if (open_) {
-				queue_.push(std::move(element));
-				deqcv_.notify_one();
-			}
-			
-			return open_;
+			return push(&element, 1);
 		}
 		
 		// Private redefinition of dequeue instantiated for ENQUEUE
@@ -197,26 +549,299 @@ namespace bluegrass {
 		typename std::enable_if_t<Q_TYPE != DEQUEUE, bool> = true>
 		bool dequeue(T& element) 
 		{
-			std::unique_lock<std::mutex> lock {m_}; 
-			while (open_ && queue_.empty()) { 
-				deqcv_.wait(lock); 
+			return pop(&element, 1);
+		}
+
+		/*
+		 * "push" moves the elements into the backend. While a bounded backend is 
+		 * full the caller parks until a consumer frees a slot or the service is 
+		 * shutdown. "pending_" counts producers inside "push" so consumers never 
+		 * observe the service as drained while an element is still landing.
+		 */
+		size_t push(T* elements, size_t count, size_t level = FIXED)
+		{
+			pending_.fetch_add(1);
+			probe_.enqueue(count);
+			size_t pushed {0};
+
+			while (pushed < count && open_) {
+				size_t n {offer(elements + pushed, count - pushed, level)};
+
+				if (!n) {
+					park(enqcv_, enqwait_, [&] { 
+						return !open_ || (n = offer(elements + pushed, count - pushed, level)); 
+					});
+				}
+
+				// consumers are woken per chunk so a partially pushed batch can drain
+				if (n) {
+					pushed += n;
+					wake(deqcv_, deqwait_, n);
+					handoff();
+				}
+			}
+
+			probe_.enqueued(pushed, count, [this] { return queue_.size(); });
+
+			// last producer out of a closed service releases consumers waiting on drain
+			if (pending_.fetch_sub(1) == 1 && !open_) {
+				{
+					std::unique_lock<std::mutex> lock {m_};
+					deqcv_.notify_all();
+				}
+				handoff();
 			}
 			
-			if (!queue_.empty()) {
-				element = std::move(queue_.front());
-				queue_.pop();
+			return pushed;
+		}
+
+		/*
+		 * "pop" moves up to "max" front elements out of the backend. While the 
+		 * backend is empty the caller parks until an element arrives or the 
+		 * service is both shutdown and drained. A pool worker passes its "slot" 
+		 * and additionally leaves empty handed when it retires, either after 
+		 * an idle timeout or to reduce a surplus left by "resize".
+		 */
+		size_t pop(T* elements, size_t max, size_t slot = FIXED)
+		{
+			size_t popped {queue_.pop(elements, max)};
+			bool worker {slot < pool_.max}, closed {false};
+			auto timeout {worker && pool_.min < pool_.max ? pool_.idle : std::chrono::milliseconds {0}};
+
+			if (!popped && pool_.wait != wait_t::BLOCK) {
+				popped = spin(elements, max, worker, closed);
+			}
+
+			while (!popped && !closed) {
+				bool woke {park(deqcv_, deqwait_, [&] {
+					// drained must be read first: no push can begin once it holds
+					closed = drained();
+					popped = queue_.pop(elements, max);
+					return popped || closed || (worker && surplus_);
+				}, timeout)};
+
+				if (!popped && !closed && worker && retire(slot, !woke)) {
+					break;
+				}
+			}
+
+			if (popped) {
+				probe_.dequeued(popped);
+				wake(enqcv_, enqwait_, popped);
+			}
+
+			return popped;
+		}
+
+		// completes an awaiter without suspending: it took an element or the service is drained
+		bool claim(awaiter& a)
+		{
+			bool closed {drained()};
+			if ((a.ok_ = queue_.pop(&a.element_, 1))) {
+				probe_.dequeued(1);
+				wake(enqcv_, enqwait_, 1);
+			}
+			return a.ok_ || closed;
+		}
+
+		/*
+		 * "suspend" links the awaiter behind the other suspended coroutines, unless 
+		 * an element landed or the service drained since "claim". Like "park", the 
+		 * awaiting count is raised under "m_" before the last attempt and "handoff" 
+		 * fences before reading it, so an awaiter is never stranded.
+		 */
+		bool suspend(awaiter& a)
+		{
+			{
+				std::unique_lock<std::mutex> lock {m_};
+				coawait_.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				bool closed {drained()};
+				if (!(a.ok_ = queue_.pop(&a.element_, 1)) && !closed) {
+					(awaiting_ ? tail_->next_ : awaiting_) = &a;
+					tail_ = &a;
+					return true;
+				}
+				coawait_.fetch_sub(1);
 			}
+
+			if (a.ok_) {
+				probe_.dequeued(1);
+				wake(enqcv_, enqwait_, 1);
+			}
+			return false;
+		}
+
+		// hands queued elements to suspended coroutines in order and resumes them
+		void handoff()
+		{
+			if constexpr (Q != DEQUEUE) {
+				return;
+			}
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!coawait_.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			awaiter* ready {nullptr};
+			awaiter** last {&ready};
+			size_t popped {0};
+			{
+				std::unique_lock<std::mutex> lock {m_};
+				bool closed {drained()};
+				while (awaiting_ && ((awaiting_->ok_ = queue_.pop(&awaiting_->element_, 1)) || closed)) {
+					popped += awaiting_->ok_;
+					*last = awaiting_;
+					last = &awaiting_->next_;
+					awaiting_ = awaiting_->next_;
+					*last = nullptr;
+					coawait_.fetch_sub(1);
+				}
+			}
+
+			if (popped) {
+				probe_.dequeued(popped);
+				wake(enqcv_, enqwait_, popped);
+			}
+
+			// the awaiter lives in the coroutine frame: read it before resuming
+			while (ready) {
+				auto* a {ready};
+				ready = a->next_;
+				scheduler::resume(a->sched_, a->handle_);
+			}
+		}
+
+		/*
+		 * "spin" retries an empty backend without parking, as set by the wait policy. 
+		 * It gives up when the service is drained, when a worker has a surplus to 
+		 * retire, or, under SPIN, once "spins" pauses and "yields" yields are spent.
+		 */
+		size_t spin(T* elements, size_t max, bool worker, bool& closed)
+		{
+			bool poll {pool_.wait == wait_t::POLL};
+			for (size_t round {0}; poll || round < pool_.spins + pool_.yields; ++round) {
+				closed = drained();
+				if (size_t popped {queue_.pop(elements, max)}) {
+					return popped;
+				}
+				if (closed || (worker && surplus_)) {
+					return 0;
+				}
+
+				if (poll || round < pool_.spins) {
+					relax();
+				} else {
+					std::this_thread::yield();
+				}
+			}
+			return 0;
+		}
+
+		// pushes into the backend, at "level" when one was given to a level backend
+		inline size_t offer(T* elements, size_t count, [[maybe_unused]] size_t level)
+		{
+			if constexpr (has_levels<B>::value) {
+				if (level != FIXED) {
+					return queue_.push(elements, count, level);
+				}
+			}
+			return queue_.push(elements, count);
+		}
+
+		// readies the calling service thread: applies thread settings and binds its lane
+		inline void prepare(size_t slot)
+		{
+			pool_.configure(slot);
+			attach(slot);
+		}
+
+		// sizes the lane table of backends with per-thread lanes
+		inline void lanes(size_t count)
+		{
+			if constexpr (has_lanes<B>::value) {
+				queue_.reserve(count ? count : 1);
+			}
+		}
+
+		// binds the calling service thread to its lane
+		inline void attach([[maybe_unused]] size_t lane)
+		{
+			if constexpr (has_lanes<B>::value) {
+				queue_.attach(lane);
+			}
+		}
+
+		inline bool drained() const
+		{
+			return !open_ && !pending_;
+		}
+
+		/*
+		 * "park" blocks the caller on "cv" until "ready" returns true or a non-zero 
+		 * "timeout" expires, returning false on expiry. The waiter count is raised 
+		 * before "ready" is evaluated under "m_", and "wake" fences before reading 
+		 * it, so a wakeup is never lost between the two.
+		 */
+		template <class P>
+		bool park(std::condition_variable& cv, std::atomic<size_t>& waiters, P ready, 
+			std::chrono::milliseconds timeout = {})
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			waiters.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
 			
-			return open_ || !queue_.empty();
+			bool woke {true};
+			if (timeout.count()) {
+				woke = cv.wait_for(lock, timeout, ready);
+			} else {
+				while (!ready()) {
+					cv.wait(lock);
+				}
+			}
+
+			waiters.fetch_sub(1);
+			return woke;
+		}
+
+		// notifies parked threads only if any are parked: the uncontended path takes no lock
+		void wake(std::condition_variable& cv, std::atomic<size_t> const& waiters, size_t count)
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiters.load(std::memory_order_relaxed)) {
+				std::unique_lock<std::mutex> lock {m_};
+				if (count > 1) {
+					cv.notify_all();
+				} else {
+					cv.notify_one();
+				}
+			}
 		}
 		
-		mutable std::condition_variable deqcv_;
+		mutable std::condition_variable deqcv_, enqcv_;
 		mutable std::mutex m_;
 
-		std::queue<T> queue_;
+		B queue_;
+		probe probe_;
+
+		// worker pool: slots [0, pool_.max) scale, NOQUEUE producers follow them
+		threads_t pool_;
+		std::function<void(size_t)> worker_;
 		std::vector<std::thread> threads_;
+		std::vector<bool> live_;
+		std::mutex pool_m_;
+		std::atomic<size_t> active_ {0}, surplus_ {0};
+
+		std::atomic<bool> open_ {true};
+		std::atomic<size_t> pending_ {0};
+		std::atomic<size_t> deqwait_ {0}, enqwait_ {0};
 
-		bool open_ {true};
+		// suspended "co_await dequeue()" coroutines in arrival order, guarded by "m_"
+		awaiter* awaiting_ {nullptr};
+		awaiter* tail_ {nullptr};
+		std::atomic<size_t> coawait_ {0};
 	};
 
 } // namespace bluegrass 
@@ -2,27 +2,65 @@
 #define __BLUEGRASS_SOCKET__
 
 #include <unistd.h>
-#include <signal.h>
 #include <fcntl.h>
 
-#include <map>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
 
 #include "bluegrass/bluetooth.hpp"
+#include "bluegrass/buffer_pool.hpp"
+#include "bluegrass/flat.hpp"
+#include "bluegrass/io_engine.hpp"
+#include "bluegrass/reactor.hpp"
 #include "bluegrass/service.hpp"
+#include "bluegrass/transport.hpp"
 
 namespace bluegrass {
+
+	// L2CAP channel modes, "DEFAULT" keeps the mode the kernel picks
+	enum class channel_t : uint8_t {
+		DEFAULT,
+		BASIC,
+		ERTM,
+		STREAMING,
+	};
+
+	/*
+	 * "link_options_t" tunes the L2CAP link of a socket when it is created. Zero 
+	 * fields keep the kernel defaults; transports other than L2CAP ignore them. 
+	 * MTUs and the channel mode are negotiated with the peer: "socket::link" 
+	 * returns the values in effect. A "BASIC" link of the default 672 byte MTU 
+	 * suits control traffic; bulk transfers gain most from larger MTUs in 
+	 * "STREAMING" mode, where the kernel supports it.
+	 */
+	struct link_options_t {
+		uint16_t imtu {0}; // largest datagram received
+		uint16_t omtu {0}; // largest datagram sent
+		uint16_t flush_to {0}; // ms until unsent data is flushed, 0xFFFF never flushes
+		int sndbuf {0}; // SO_SNDBUF
+		int rcvbuf {0}; // SO_RCVBUF
+		channel_t mode {channel_t::DEFAULT};
+	};
 	
 	/*
 	 * "socket" wraps a Bluetooth socket and provides send and receive functionality.
 	 */
 	class socket {
 		friend class async_socket;		
+		friend class connection_pool;
+		friend class compressor;
+		friend class framer;
+		friend class send_queue;
 	public:
 		// default constructor does not create kernel level socket
 		socket() : handle_ {-1} {};
 		
 		// creates a kernel level socket to provided address and port
-		socket(bdaddr_t, uint16_t);
+		socket(bdaddr_t, uint16_t, link_options_t const& ={});
 
 		socket(socket const&) = delete;
 		socket(socket&&);
@@ -35,6 +73,9 @@ namespace bluegrass {
 
 		// safely closes socket if active
 		void close();
+
+		// link options in effect, zero where the kernel does not report them
+		link_options_t link() const;
 		
 		// receives data from the socket into data reference. 
 		template <class T, 
@@ -58,11 +99,158 @@ namespace bluegrass {
 			return false;	
 		}
 
+		/*
+		 * Byte forms of "send" and "receive" for datagrams whose length is only known 
+		 * at runtime. "receive" returns the full length of the datagram, 0 on error: 
+		 * a length greater than "data.size()" means the datagram was truncated. 
+		 * Protocols which ignore MSG_TRUNC only report "data.size() + 1", a lower 
+		 * bound: peeking one byte does not tell how long a datagram is, use 
+		 * "pending" or "receive_buffer" to never consume one too short a buffer.
+		 */
+		bool send(std::span<const std::byte> data, int flags=0) const;
+
+		size_t receive(std::span<std::byte> data, int flags=0) const;
+
+		/*
+		 * "receive_buffer" checks a buffer the size of the next datagram out of the 
+		 * "buffer_pool" and receives the datagram into it: usually one peek into 
+		 * the smallest pooled buffer, then one receive. The buffer is empty on error.
+		 */
+		buffer_t receive_buffer(int flags=0) const;
+
+		// length of the next datagram, which stays queued, 0 on error
+		size_t pending(int flags=0) const;
+
+		/*
+		 * Forms of "send" and "receive" for types described in the flat wire format, 
+		 * see "flat.hpp". "receive<T>" hands out a view over the pooled buffer the 
+		 * datagram was received into, which is false on error or a malformed datagram.
+		 */
+		template <class T, 
+		typename std::enable_if_t<is_described_v<T>, bool> = true>
+		bool send(T const& data, int flags=0) const
+		{
+			auto buffer {buffer_pool::access().acquire(flat_size(data))};
+			return flat_write(data, buffer.span()) && send(std::as_bytes(buffer.span()), flags);
+		}
+
+		template <class T, 
+		typename std::enable_if_t<is_described_v<T>, bool> = true>
+		flat_view<T> receive(int flags=0) const
+		{
+			return flat_view<T> {receive_buffer(flags)};
+		}
+
+		/*
+		 * "sendv" gathers the buffers into one datagram and "receivev" scatters one 
+		 * datagram across the buffers in order, so a header and its payload never 
+		 * have to be packed into or unpacked from one struct. "receivev" returns 
+		 * the bytes received, -1 on error.
+		 */
+		bool sendv(std::span<const iovec> buffers, int flags=0) const;
+
+		ssize_t receivev(std::span<const iovec> buffers, int flags=0) const;
+
+		// sends "header" followed by "payload" as one datagram, straight from caller memory
+		template <class H, 
+		typename std::enable_if_t<std::is_trivial_v<H>, bool> = true>
+		bool sendv(const H* header, std::span<const std::byte> payload, int flags=0) const
+		{
+			iovec buffers[2] {{(void*) header, sizeof(H)}, {(void*) payload.data(), payload.size()}};
+			return sendv(buffers, flags);
+		}
+
+		// receives a datagram into "header" and its remainder into "payload", returns the payload bytes
+		template <class H, 
+		typename std::enable_if_t<std::is_trivial_v<H>, bool> = true>
+		ssize_t receivev(H* header, std::span<std::byte> payload, int flags=0) const
+		{
+			iovec buffers[2] {{(void*) header, sizeof(H)}, {(void*) payload.data(), payload.size()}};
+			ssize_t n {receivev(buffers, flags)};
+			return n < static_cast<ssize_t>(sizeof(H)) ? -1 : n - static_cast<ssize_t>(sizeof(H));
+		}
+
+		/*
+		 * "send_many" and "receive_many" move up to "count" datagrams of one "T" each 
+		 * with one sendmmsg or recvmmsg call per 64 datagrams. Both return how many 
+		 * datagrams were moved, which are always the first ones. If "results" is given, 
+		 * results[i] holds the bytes moved by datagram i, or -errno. "receive_many" 
+		 * waits for the first datagram only (MSG_WAITFORONE) and then takes what is 
+		 * queued, instead of waiting for "count" datagrams.
+		 */
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		size_t send_many(const T* data, size_t count, ssize_t* results=nullptr, int flags=0) const
+		{
+			return transfer_many(true, (void*) data, sizeof(T), count, results, flags | MSG_DONTWAIT);
+		}
+
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		size_t receive_many(T* data, size_t count, ssize_t* results=nullptr, int flags=MSG_WAITFORONE) const
+		{
+			return transfer_many(false, (void*) data, sizeof(T), count, results, flags);
+		}
+
+		/*
+		 * "receive_op" and "send_op" describe the same transfers as "receive" and 
+		 * "send" as one operation of an io_engine batch (see io_engine.hpp).
+		 */
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		io_op_t receive_op(T* data, int flags=0) const
+		{
+			return {handle_, (void*) data, sizeof(T), flags};
+		}
+
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		io_op_t send_op(const T* data, int flags=0) const
+		{
+			return {handle_, (void*) data, sizeof(T), flags | MSG_DONTWAIT};
+		}
+
+		/*
+		 * "async_receive" and "async_send" are the awaitable forms for coroutines:
+		 *
+		 *	ssize_t n {co_await conn.async_receive(&packet)};
+		 *
+		 * While the socket would block, the coroutine is parked on the reactor instead 
+		 * of its thread. It resumes with the number of bytes moved, -1 on error. 
+		 * "data" must stay valid until then.
+		 */
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		auto async_receive(T* data, int flags=0) const
+		{
+			return io_awaiter {handle_, EPOLLIN, [handle = handle_, data, flags] {
+				return c_recv(handle, (void*) data, sizeof(T), flags | MSG_DONTWAIT);
+			}};
+		}
+
+		template <class T, 
+		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
+		auto async_send(const T* data, int flags=0) const
+		{
+			return io_awaiter {handle_, EPOLLOUT, [handle = handle_, data, flags] {
+				return c_send(handle, (void*) data, sizeof(T), flags | MSG_DONTWAIT);
+			}};
+		}
+
 	private:
 		socket(int);
 
-		// creates an L2CAP socket and configures the socket address struct.
-		sockaddr_l2 setup(bdaddr_t, uint16_t);
+		// creates a socket on the current transport, which is returned (see transport.hpp)
+		transport& setup();
+
+		// applies link options before the socket connects or listens, false if any failed
+		bool configure(link_options_t const&);
+
+		// peeks the next datagram into a pooled buffer of its size, empty on error
+		buffer_t peek(int flags) const;
+
+		// moves "count" datagrams of "size" bytes laid out back to back from "data"
+		size_t transfer_many(bool sending, void* data, size_t size, size_t count, ssize_t* results, int flags) const;
 
 		template <class T, 
 		typename std::enable_if_t<std::is_trivial_v<T>, bool> = true>
@@ -95,41 +283,80 @@ namespace bluegrass {
 		~scoped_socket();
 	};
 
-	// Enum to select the behavior of SIGIO signals for async_socket 
+	// Enum to select the behavior of input events for async_socket 
 	enum class async_t : bool {
 		SERVER,
 		CLIENT,
 	};
 
 	/*
-	 * "async_socket" installs a Linux SIGIO signal handler on the parent class socket.
+	 * "async_socket" binds the parent class socket to the epoll "reactor" (see reactor.hpp).
 	 * If the async_socket was constructed with "CLIENT", the socket enqueues itself onto 
-	 * the "service" it was constructed with when the signal is triggered. If the 
-	 * async_socket was constructed with "SERVER", the socket enqueues the connecting 
-	 * client onto the "service" it was constructed with when the signal is triggered.
+	 * the "service" it was constructed with when new input arrives. If the 
+	 * async_socket was constructed with "SERVER", the socket accepts every connecting 
+	 * client and enqueues them onto the "service" it was constructed with. When the 
+	 * io_uring acceptor is available, one multishot accept replaces the accept calls.
+	 * Sockets made ready during one reactor wakeup are enqueued in one bulk call per 
+	 * service and level. A "CLIENT" socket is enqueued once for all the input which 
+	 * arrived, and not again until its routine has drained it and calls "rearm": 
+	 * no two service threads ever read it at the same time.
+	 * If a "classify" function is given, it picks the service level of the socket: 
+	 * level 0 is drained before level 1, so control traffic can preempt bulk data.
 	 */
 	class async_socket : public socket {
 	public:
-		using service_handle = service<socket, ENQUEUE>;
+		// lock-free rings keep the reactor enqueue path free of mutexes while not full
+		using service_handle = service<socket, ENQUEUE, level_queue<socket, 2, 8, ring_queue<socket, 256>>>;
+
+		// runs on a reactor thread: must not block, like a MSG_PEEK | MSG_DONTWAIT receive
+		using classify_t = size_t (*)(socket const&);
 
-		async_socket(bdaddr_t, uint16_t, service_handle&, async_t);
+		// a "SERVER" passes its link options on to every accepted client
+		async_socket(bdaddr_t, uint16_t, service_handle&, async_t, classify_t=nullptr, link_options_t const& ={});
 
-		async_socket(socket&&, service_handle&, async_t);
+		async_socket(socket&&, service_handle&, async_t, classify_t=nullptr);
 
 		async_socket(async_socket&&) = default;
 
 		~async_socket();
 
+		// enqueues the "CLIENT" socket "conn" again on its next input, or at once if some is unread
+		static void rearm(socket const& conn);
+
 	private:
-		using comm_group = std::pair<async_t, service_handle&>;
-		using connections = std::map<int, std::pair<async_t, service_handle&>>;
+		// reactor binding, or acceptor listener for a "SERVER", of one async_socket
+		struct comm_group : reactor::binding_t, acceptor::listener_t {
+			comm_group(async_t, service_handle&, classify_t);
+
+			void ready(int) override;
+
+			void accepted(int) override;
+
+			// queues a ready socket into the batch of its service and level
+			void collect(socket&&);
+
+			// enqueues the batches collected by the calling reactor thread
+			static void dispatch();
+
+			async_t type;
+			service_handle& svc;
+			classify_t classify;
+		};
+
+		struct batch_t {
+			service_handle* svc;
+			size_t level;
+			std::vector<socket> sockets;
+		};
+
+		// marks a batch enqueued without a level
+		static constexpr size_t UNLEVELED {static_cast<size_t>(-1)};
 
 		void async(int);
 
-		// sigio signal handler hook
-		static void sigio(int, siginfo_t*, void*);
+		std::unique_ptr<comm_group> group_;
 
-		static connections services_;
+		inline static thread_local std::vector<batch_t> batches_ {};
 	};
 
 } // namespace bluegrass 
@@ -0,0 +1,98 @@
+#ifndef __BLUEGRASS_TRANSPORT__
+#define __BLUEGRASS_TRANSPORT__
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bluegrass/bluetooth.hpp"
+
+namespace bluegrass {
+
+	/*
+	 * "transport" creates, connects and binds the sockets of bluegrass and finds
+	 * the devices around this one. Every transport moves SOCK_SEQPACKET datagrams
+	 * and addresses devices by "bdaddr_t" and port, so "socket", "async_socket"
+	 * and "router" run unchanged over any of them. Sockets use the transport
+	 * selected when they are created: "bluetooth_transport" unless another one
+	 * was selected with "use".
+	 */
+	class transport {
+	public:
+		virtual ~transport() = default;
+
+		// the transport new sockets are created on
+		static transport& current();
+
+		// selects the transport of new sockets: "selected" must outlive them
+		static void use(transport& selected);
+
+		// creates an unconnected socket, -1 on failure
+		virtual int open() const = 0;
+
+		// same return values as connect(2) and bind(2)
+		virtual int connect(int fd, bdaddr_t, uint16_t) const = 0;
+		virtual int bind(int fd, bdaddr_t, uint16_t) const = 0;
+
+		// true if its sockets are L2CAP sockets which take "link_options_t"
+		virtual bool l2cap() const = 0;
+
+		// address of this device
+		virtual bdaddr_t self() const = 0;
+
+		// finds up to "max" devices other than this one
+		virtual void discover(size_t max, std::vector<bdaddr_t>&) const = 0;
+	};
+
+	// L2CAP over the Bluetooth controller, devices are found with an HCI inquiry
+	class bluetooth_transport : public transport {
+	public:
+		int open() const override;
+
+		int connect(int, bdaddr_t, uint16_t) const override;
+		int bind(int, bdaddr_t, uint16_t) const override;
+
+		bool l2cap() const override;
+
+		bdaddr_t self() const override;
+
+		void discover(size_t, std::vector<bdaddr_t>&) const override;
+	};
+
+	/*
+	 * "unix_transport" runs bluegrass without a radio: every address and port is
+	 * an AF_UNIX SOCK_SEQPACKET socket file "<directory>/<address>.<port>", and
+	 * binding to ANY binds to the "self" address. "discover" lists the devices
+	 * with a socket file in "directory". Several devices can share a process:
+	 * sockets take the "self" address current when they are bound, so change it
+	 * between constructing the servers or routers of different devices.
+	 */
+	class unix_transport : public transport {
+	public:
+		explicit unix_transport(bdaddr_t self, std::string directory="/tmp/bluegrass");
+
+		int open() const override;
+
+		int connect(int, bdaddr_t, uint16_t) const override;
+		int bind(int, bdaddr_t, uint16_t) const override;
+
+		bool l2cap() const override;
+
+		bdaddr_t self() const override;
+
+		void self(bdaddr_t);
+
+		void discover(size_t, std::vector<bdaddr_t>&) const override;
+
+	private:
+		// socket file of "addr" and "port"
+		std::string path(bdaddr_t addr, uint16_t port) const;
+
+		std::string const directory_;
+		mutable std::mutex m_;
+		bdaddr_t self_;
+	};
+
+} // namespace bluegrass
+
+#endif
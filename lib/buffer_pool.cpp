@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <bit>
+#include <new>
+
+#include "bluegrass/buffer_pool.hpp"
+
+namespace bluegrass {
+
+	// slabs and unpooled buffers are aligned for any socket or SIMD access
+	static constexpr std::align_val_t ALIGN {64};
+
+	buffer_pool::buffer_pool()
+	{
+		alive_ = true;
+	}
+
+	buffer_pool::~buffer_pool()
+	{
+		alive_ = false;
+		for (auto slab : slabs_) {
+			::operator delete[](slab, ALIGN);
+		}
+	}
+
+	size_t buffer_pool::size_class(size_t size)
+	{
+		if (size > MAX) {
+			return CLASSES;
+		}
+		return std::countr_zero(std::bit_ceil(size < MIN ? MIN : size) / MIN);
+	}
+
+	buffer_t buffer_pool::acquire(size_t size)
+	{
+		size_t index {size_class(size)};
+		if (index == CLASSES) {
+			return {static_cast<std::byte*>(::operator new[](size, ALIGN)), size, size};
+		}
+
+		size_t capacity {MIN << index};
+		auto& cache {cache_.free[index]};
+		if (cache.empty()) {
+			std::unique_lock<std::mutex> lock {m_};
+			auto& shared {free_[index]};
+
+			// carve a new slab into buffers of this class once the shared list is empty too
+			if (shared.empty()) {
+				auto slab {static_cast<std::byte*>(::operator new[](SLAB, ALIGN))};
+				slabs_.push_back(slab);
+				for (size_t offset {0}; offset < SLAB; offset += capacity) {
+					shared.push_back(slab + offset);
+				}
+			}
+
+			size_t count {std::min(shared.size(), CACHED / 2)};
+			cache.insert(cache.end(), shared.end() - count, shared.end());
+			shared.resize(shared.size() - count);
+		}
+
+		auto data {cache.back()};
+		cache.pop_back();
+		return {data, size, capacity};
+	}
+
+	void buffer_pool::release(std::byte* data, size_t capacity)
+	{
+		if (!alive_) {
+			return;
+		}
+
+		size_t index {size_class(capacity)};
+		if (index == CLASSES) {
+			::operator delete[](data, ALIGN);
+			return;
+		}
+
+		auto& cache {cache_.free[index]};
+		if (cache.size() == CACHED) {
+			std::unique_lock<std::mutex> lock {m_};
+			free_[index].insert(free_[index].end(), cache.end() - CACHED / 2, cache.end());
+			cache.resize(CACHED / 2);
+		}
+		cache.push_back(data);
+	}
+
+	// an exiting thread hands its cached buffers to the shared free lists
+	buffer_pool::cache_t::~cache_t()
+	{
+		if (!alive_) {
+			return;
+		}
+
+		auto& pool {buffer_pool::access()};
+		std::unique_lock<std::mutex> lock {pool.m_};
+		for (size_t index {0}; index < CLASSES; ++index) {
+			pool.free_[index].insert(pool.free_[index].end(), free[index].begin(), free[index].end());
+		}
+	}
+
+} // namespace bluegrass
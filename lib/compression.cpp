@@ -0,0 +1,280 @@
+#include <poll.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "bluegrass/compression.hpp"
+
+namespace bluegrass {
+
+	static constexpr size_t MIN_MATCH {4};
+	static constexpr size_t MAX_OFFSET {UINT16_MAX};
+
+	// the block format ends in literals: matches start 12 bytes and end 5 bytes before the end
+	static constexpr size_t MATCH_LIMIT {12};
+	static constexpr size_t LAST_LITERALS {5};
+
+	static constexpr int HASH_BITS {12};
+
+	static inline uint32_t read32(const uint8_t* data)
+	{
+		uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	static inline size_t hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// writes a length beyond its 4 bit token nibble as a run of 255s and a remainder
+	static inline void extend(uint8_t* out, size_t& o, size_t length)
+	{
+		for (; length >= UINT8_MAX; length -= UINT8_MAX) {
+			out[o++] = UINT8_MAX;
+		}
+		out[o++] = static_cast<uint8_t>(length);
+	}
+
+	/*
+	 * "sequence" writes a token, the literals before a match and the match, or
+	 * only the literals for the last sequence of a block ("match" 0). Refuses
+	 * if the worst case does not fit in the bytes left.
+	 */
+	static bool sequence(std::span<std::byte> out, size_t& o, const uint8_t* literals, size_t count, size_t offset, size_t match)
+	{
+		if (1 + count / UINT8_MAX + 1 + count + 2 + match / UINT8_MAX + 1 > out.size() - o) {
+			return false;
+		}
+
+		auto data {reinterpret_cast<uint8_t*>(out.data())};
+		size_t length {match ? match - MIN_MATCH : 0};
+		data[o++] = static_cast<uint8_t>(std::min<size_t>(count, 15) << 4 | std::min<size_t>(length, 15));
+		if (count >= 15) {
+			extend(data, o, count - 15);
+		}
+		if (count) {
+			std::memcpy(data + o, literals, count);
+			o += count;
+		}
+
+		if (match) {
+			data[o++] = static_cast<uint8_t>(offset);
+			data[o++] = static_cast<uint8_t>(offset >> 8);
+			if (length >= 15) {
+				extend(data, o, length - 15);
+			}
+		}
+		return true;
+	}
+
+	size_t lz_compress(std::span<const std::byte> in, std::span<std::byte> out)
+	{
+		auto data {reinterpret_cast<const uint8_t*>(in.data())};
+		size_t size {in.size()}, o {0}, anchor {0};
+
+		// positions of the last 4 byte sequence with each hash, candidates are verified before use
+		std::array<uint32_t, 1 << HASH_BITS> table {};
+		for (size_t i {0}; i + MATCH_LIMIT < size;) {
+			uint32_t current {read32(data + i)};
+			size_t candidate {table[hash(current)]};
+			table[hash(current)] = static_cast<uint32_t>(i);
+
+			if (candidate >= i || i - candidate > MAX_OFFSET || read32(data + candidate) != current) {
+				++i;
+				continue;
+			}
+
+			size_t match {MIN_MATCH};
+			while (i + match < size - LAST_LITERALS && data[candidate + match] == data[i + match]) {
+				++match;
+			}
+			if (!sequence(out, o, data + anchor, i - anchor, i - candidate, match)) {
+				return 0;
+			}
+			i += match;
+			anchor = i;
+		}
+
+		return sequence(out, o, data + anchor, size - anchor, 0, 0) ? o : 0;
+	}
+
+	// every length and offset is checked against both spans: malformed input never reads or writes out of bounds
+	ssize_t lz_decompress(std::span<const std::byte> in, std::span<std::byte> out)
+	{
+		auto source {reinterpret_cast<const uint8_t*>(in.data())};
+		auto data {reinterpret_cast<uint8_t*>(out.data())};
+		size_t size {in.size()}, capacity {out.size()}, i {0}, o {0};
+
+		auto length {[&](size_t nibble) -> ssize_t {
+			if (nibble == 15) {
+				uint8_t byte;
+				do {
+					if (i == size) {
+						return -1;
+					}
+					byte = source[i++];
+					nibble += byte;
+				} while (byte == UINT8_MAX);
+			}
+			return nibble;
+		}};
+
+		while (i < size) {
+			uint8_t token {source[i++]};
+			ssize_t count {length(token >> 4)};
+			if (count < 0 || static_cast<size_t>(count) > size - i || static_cast<size_t>(count) > capacity - o) {
+				return -1;
+			}
+			if (count) {
+				std::memcpy(data + o, source + i, count);
+				i += count;
+				o += count;
+			}
+
+			// the last sequence is only literals
+			if (i == size) {
+				break;
+			}
+			if (size - i < 2) {
+				return -1;
+			}
+			size_t offset {source[i] | static_cast<size_t>(source[i + 1]) << 8};
+			i += 2;
+
+			ssize_t match {length(token & 15)};
+			if (match < 0 || !offset || offset > o || static_cast<size_t>(match) + MIN_MATCH > capacity - o) {
+				return -1;
+			}
+
+			// byte by byte: a match may overlap the bytes it produces
+			for (size_t end {o + match + MIN_MATCH}; o < end; ++o) {
+				data[o] = data[o - offset];
+			}
+		}
+
+		return o;
+	}
+
+	/*
+	 * Both ends send their HELLO first and then wait for the HELLO and the ACK 
+	 * of the other, so neither blocks the other. Only negotiation messages are 
+	 * consumed: a payload sent by a peer which gave up first is left for 
+	 * "receive". An end constructed after its peer gave up still finds the 
+	 * HELLO of the peer, but never an ACK to its own: it stays plain as well.
+	 */
+	compressor::compressor(socket const& conn, compression_t const& options) :
+		conn_ {conn},
+		options_ {options}
+	{
+		packed_t hello {codec_t::HELLO, 0, static_cast<uint16_t>(options_.enabled ? offer(codec_t::LZ) : 0)};
+		if (!conn_.send(&hello)) {
+			return;
+		}
+
+		auto deadline {std::chrono::steady_clock::now() + options_.timeout};
+		bool heard {false}, acknowledged {false};
+		uint16_t offered {0};
+		while (!heard || !acknowledged) {
+			auto left {std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now())};
+			pollfd fd {conn_.handle_, POLLIN, 0};
+			packed_t answer {};
+			if (left.count() < 0 || poll(&fd, 1, static_cast<int>(left.count())) != 1 || !control(answer)) {
+				return;
+			}
+
+			conn_.receive(&answer);
+			if (answer.codec == codec_t::ACK) {
+				acknowledged = true;
+				continue;
+			}
+
+			heard = true;
+			offered = answer.size;
+			packed_t ack {codec_t::ACK, 0, 0};
+			if (!conn_.send(&ack)) {
+				return;
+			}
+		}
+
+		negotiated_ = true;
+		compressing_ = options_.enabled && offered & offer(codec_t::LZ);
+	}
+
+	bool compressor::control(packed_t& header) const
+	{
+		return conn_.receive(std::as_writable_bytes(std::span {&header, 1}), MSG_PEEK) == sizeof(header)
+			&& (header.codec == codec_t::HELLO || header.codec == codec_t::ACK);
+	}
+
+	bool compressor::send(std::span<const std::byte> payload)
+	{
+		if (!negotiated_) {
+			return conn_.send(payload);
+		}
+		if (payload.size() > UINT16_MAX) {
+			return false;
+		}
+
+		packed_t header {codec_t::RAW, 0, static_cast<uint16_t>(payload.size())};
+		if (compressing_ && !payload.empty() && payload.size() >= options_.threshold) {
+			// only output smaller than the payload is worth sending
+			auto packed {buffer_pool::access().acquire(payload.size() - 1)};
+			if (size_t n {lz_compress(payload, packed.span())}) {
+				header.codec = codec_t::LZ;
+				if (!conn_.sendv(&header, packed.span().first(n))) {
+					return false;
+				}
+				saved_ += payload.size() - n;
+				return true;
+			}
+		}
+		return conn_.sendv(&header, payload);
+	}
+
+	// datagrams which are no payload or do not decompress to their size are dropped
+	buffer_t compressor::receive()
+	{
+		if (!negotiated_) {
+			// the peer negotiated after this end gave up: the ends disagree on framing
+			packed_t header {};
+			if (control(header)) {
+				conn_.receive(&header);
+				return {};
+			}
+			return conn_.receive_buffer();
+		}
+
+		while (true) {
+			size_t length {conn_.pending()};
+			if (!length) {
+				return {};
+			}
+
+			packed_t header {};
+			if (length < sizeof(header)) {
+				std::byte dropped {};
+				conn_.receive(std::span {&dropped, 1});
+				continue;
+			}
+
+			auto datagram {buffer_pool::access().acquire(length - sizeof(header))};
+			if (conn_.receivev(&header, datagram.span()) < 0) {
+				return {};
+			}
+
+			if (header.codec == codec_t::RAW && header.size == datagram.size()) {
+				return datagram;
+			}
+			if (header.codec == codec_t::LZ) {
+				auto payload {buffer_pool::access().acquire(header.size)};
+				if (lz_decompress(datagram.span(), payload.span()) == header.size) {
+					return payload;
+				}
+			}
+		}
+	}
+
+} // namespace bluegrass
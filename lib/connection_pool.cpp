@@ -0,0 +1,163 @@
+#include <poll.h>
+
+#include <optional>
+#include <utility>
+
+#include "bluegrass/connection_pool.hpp"
+
+namespace bluegrass {
+
+	connection_pool::lease_t::lease_t(connection_pool* pool, bdaddr_t addr, uint16_t port, socket&& conn, bool reused) :
+		pool_ {pool}, addr_ {addr}, port_ {port}, conn_ {std::move(conn)}, reused_ {reused}
+	{}
+
+	connection_pool::lease_t::lease_t(lease_t&& other) :
+		pool_ {std::exchange(other.pool_, nullptr)},
+		addr_ {other.addr_},
+		port_ {other.port_},
+		conn_ {std::move(other.conn_)},
+		reusable_ {other.reusable_},
+		reused_ {other.reused_}
+	{}
+
+	connection_pool::lease_t& connection_pool::lease_t::operator=(lease_t&& other)
+	{
+		if (this != &other) {
+			release();
+			pool_ = std::exchange(other.pool_, nullptr);
+			addr_ = other.addr_;
+			port_ = other.port_;
+			conn_ = std::move(other.conn_);
+			reusable_ = other.reusable_;
+			reused_ = other.reused_;
+		}
+		return *this;
+	}
+
+	connection_pool::lease_t::~lease_t()
+	{
+		release();
+	}
+
+	void connection_pool::lease_t::release()
+	{
+		if (pool_ && reusable_ && conn_.handle_ != -1) {
+			pool_->give_back(addr_, port_, std::move(conn_));
+		} else {
+			conn_.close();
+		}
+		pool_ = nullptr;
+		conn_.handle_ = -1;
+	}
+
+	connection_pool::connection_pool(pool_limits_t const& limits) : limits_ {limits} {}
+
+	connection_pool::~connection_pool()
+	{
+		clear();
+	}
+
+	/*
+	 * Idle connections are taken most recently used first: they are the least
+	 * likely to have been dropped by the peer. Connections failing the health
+	 * check are closed, and a new one is connected without holding the lock.
+	 */
+	connection_pool::lease_t connection_pool::borrow(bdaddr_t addr, uint16_t port)
+	{
+		std::list<entry_t> stale {};
+		std::optional<socket> found {};
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			expire(std::chrono::steady_clock::now());
+
+			for (auto it {idle_.begin()}; it != idle_.end() && !found;) {
+				if (it->addr != addr || it->port != port) {
+					++it;
+				} else if (healthy(it->conn)) {
+					found = std::move(it->conn);
+					it = idle_.erase(it);
+				} else {
+					auto next {std::next(it)};
+					stale.splice(stale.end(), idle_, it);
+					it = next;
+				}
+			}
+		}
+
+		for (auto& entry : stale) {
+			entry.conn.close();
+		}
+
+		if (found) {
+			return {this, addr, port, std::move(*found), true};
+		}
+		return {this, addr, port, socket {addr, port}, false};
+	}
+
+	size_t connection_pool::idle()
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return idle_.size();
+	}
+
+	void connection_pool::clear()
+	{
+		std::list<entry_t> closing {};
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			closing.swap(idle_);
+		}
+
+		for (auto& entry : closing) {
+			entry.conn.close();
+		}
+	}
+
+	bool connection_pool::healthy(socket const& conn)
+	{
+		pollfd fd {conn.handle_, POLLIN | POLLRDHUP, 0};
+		return poll(&fd, 1, 0) == 0;
+	}
+
+	// the returned connection becomes the most recent, the least recent ones past a limit are closed
+	void connection_pool::give_back(bdaddr_t addr, uint16_t port, socket&& conn)
+	{
+		auto now {std::chrono::steady_clock::now()};
+		std::list<entry_t> evicted {};
+		{
+			std::unique_lock<std::mutex> lock {m_};
+			expire(now);
+			idle_.push_front({addr, port, std::move(conn), now});
+
+			size_t peer {0};
+			for (auto it {idle_.begin()}; it != idle_.end();) {
+				bool same {it->addr == addr && it->port == port};
+				if (same && ++peer > limits_.per_peer) {
+					auto next {std::next(it)};
+					evicted.splice(evicted.end(), idle_, it);
+					it = next;
+				} else {
+					++it;
+				}
+			}
+
+			while (idle_.size() > limits_.total) {
+				evicted.splice(evicted.end(), idle_, std::prev(idle_.end()));
+			}
+		}
+
+		for (auto& entry : evicted) {
+			entry.conn.close();
+		}
+	}
+
+	// closing under the lock is cheap: idle connections have no pending output to flush
+	void connection_pool::expire(std::chrono::steady_clock::time_point now)
+	{
+		while (!idle_.empty() && now - idle_.back().since > limits_.max_idle) {
+			idle_.back().conn.close();
+			idle_.pop_back();
+		}
+	}
+
+} // namespace bluegrass
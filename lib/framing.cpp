@@ -0,0 +1,137 @@
+#include <poll.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "bluegrass/framing.hpp"
+
+namespace bluegrass {
+
+	// the default L2CAP MTU, used when the link reports none
+	static constexpr size_t DEFAULT_MTU {672};
+
+	framer::framer(socket const& conn, framing_t const& limits) :
+		conn_ {conn},
+		limits_ {limits}
+	{
+		auto link {conn_.link()};
+		mtu_ = limits_.mtu ? limits_.mtu : link.omtu ? link.omtu : DEFAULT_MTU;
+		mtu_ = std::max(mtu_, sizeof(fragment_t) + 1);
+
+		// datagrams as large as this side may receive, longer ones are truncated and dropped
+		scratch_ = buffer_pool::access().acquire(std::max<size_t>(mtu_, link.imtu));
+	}
+
+	bool framer::send(std::span<const std::byte> message)
+	{
+		if (message.size() > limits_.max_message) {
+			return false;
+		}
+
+		fragment_t header {static_cast<uint32_t>(message.size()), 0, next_++, 0};
+		size_t chunk {mtu_ - sizeof(fragment_t)};
+		do {
+			auto part {message.subspan(header.offset, std::min(chunk, message.size() - header.offset))};
+			while (!conn_.sendv(&header, part)) {
+				pollfd fd {conn_.handle_, POLLOUT, 0};
+				if (errno != EAGAIN || poll(&fd, 1, static_cast<int>(limits_.timeout.count())) != 1) {
+					return false;
+				}
+			}
+			header.offset += part.size();
+		} while (header.offset < message.size());
+
+		return true;
+	}
+
+	// a zero length datagram is never a fragment: it is an error or a closed connection
+	buffer_t framer::receive()
+	{
+		while (true) {
+			size_t n {conn_.receive(scratch_.span())};
+			if (!n) {
+				return {};
+			}
+
+			if (n > scratch_.size()) {
+				++dropped_;
+			} else if (auto message {feed(scratch_.span().first(n))}) {
+				return message;
+			}
+		}
+	}
+
+	/*
+	 * A message in one fragment is copied out right away. Fragments of longer
+	 * messages are copied to their offset in the buffer of their message, which
+	 * is handed out once every byte has arrived. A message is sent in order, so
+	 * every fragment starts where the bytes received so far end: a repeated,
+	 * overlapping or missing fragment drops its message instead of leaving a gap.
+	 */
+	buffer_t framer::feed(std::span<const std::byte> datagram)
+	{
+		auto now {std::chrono::steady_clock::now()};
+		expire(now);
+
+		fragment_t header;
+		if (datagram.size() < sizeof(header)) {
+			++dropped_;
+			return {};
+		}
+		std::memcpy(&header, datagram.data(), sizeof(header));
+		auto bytes {datagram.subspan(sizeof(header))};
+
+		if (header.size > limits_.max_message || header.offset > header.size || bytes.size() > header.size - header.offset) {
+			++dropped_;
+			return {};
+		}
+
+		auto partial {std::find_if(pending_.begin(), pending_.end(), [&header](partial_t const& p) {
+			return p.message == header.message;
+		})};
+
+		if (partial == pending_.end()) {
+			if (header.offset == 0 && bytes.size() == header.size) {
+				auto message {buffer_pool::access().acquire(header.size)};
+				std::copy(bytes.begin(), bytes.end(), message.data());
+				return message;
+			}
+
+			if (header.offset != 0) {
+				++dropped_;
+				return {};
+			}
+
+			// pending messages are kept oldest first
+			if (pending_.size() == limits_.max_pending) {
+				pending_.erase(pending_.begin());
+				++dropped_;
+			}
+			partial = pending_.insert(pending_.end(), {header.message, 0, now, buffer_pool::access().acquire(header.size)});
+		} else if (partial->buffer.size() != header.size || header.offset != partial->received) {
+			pending_.erase(partial);
+			++dropped_;
+			return {};
+		}
+
+		std::copy(bytes.begin(), bytes.end(), partial->buffer.data() + header.offset);
+		partial->received += bytes.size();
+		if (partial->received < header.size) {
+			return {};
+		}
+
+		auto message {std::move(partial->buffer)};
+		pending_.erase(partial);
+		return message;
+	}
+
+	void framer::expire(std::chrono::steady_clock::time_point now)
+	{
+		auto expired {std::remove_if(pending_.begin(), pending_.end(), [&](partial_t const& p) {
+			return now - p.started > limits_.timeout;
+		})};
+		dropped_ += pending_.end() - expired;
+		pending_.erase(expired, pending_.end());
+	}
+
+} // namespace bluegrass
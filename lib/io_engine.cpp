@@ -0,0 +1,489 @@
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+#include <cstdio>
+#include <cstring>
+#endif
+
+#include "bluegrass/io_engine.hpp"
+
+namespace bluegrass {
+
+#ifdef IO_URING
+	/*
+	 * "uring_t" maps the rings of one io_uring instance. It is driven with the raw
+	 * syscalls, so no liburing is needed. A ring is not thread safe: io_engine
+	 * rings are per thread and the acceptor ring is guarded by its mutex.
+	 */
+	struct uring_t {
+		explicit uring_t(unsigned entries)
+		{
+			io_uring_params params {};
+			fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+			if (fd == -1) {
+				return;
+			}
+
+			sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				sq_len = cq_len = std::max(sq_len, cq_len);
+			}
+			sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+
+			sq = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			cq = params.features & IORING_FEAT_SINGLE_MMAP ? sq :
+				mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			sqes = static_cast<io_uring_sqe*>(
+				mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+
+			if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+				release();
+				return;
+			}
+
+			auto* s {static_cast<char*>(sq)};
+			sq_head = reinterpret_cast<unsigned*>(s + params.sq_off.head);
+			sq_tail = reinterpret_cast<unsigned*>(s + params.sq_off.tail);
+			sq_mask = *reinterpret_cast<unsigned*>(s + params.sq_off.ring_mask);
+			sq_array = reinterpret_cast<unsigned*>(s + params.sq_off.array);
+			sq_entries = params.sq_entries;
+
+			auto* c {static_cast<char*>(cq)};
+			cq_head = reinterpret_cast<unsigned*>(c + params.cq_off.head);
+			cq_tail = reinterpret_cast<unsigned*>(c + params.cq_off.tail);
+			cq_mask = *reinterpret_cast<unsigned*>(c + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(c + params.cq_off.cqes);
+		}
+
+		uring_t(uring_t const&) = delete;
+		uring_t& operator=(uring_t const&) = delete;
+
+		~uring_t()
+		{
+			release();
+		}
+
+		bool valid() const
+		{
+			return fd != -1;
+		}
+
+		// returns a cleared submission entry, null while the submission ring is full
+		io_uring_sqe* next()
+		{
+			unsigned tail {*sq_tail};
+			if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries) {
+				return nullptr;
+			}
+
+			unsigned index {tail & sq_mask};
+			sq_array[index] = index;
+			std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+			__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+			return &sqes[index];
+		}
+
+		// submits "submit" entries and waits for "wait" completions, -errno on failure
+		int enter(unsigned submit, unsigned wait)
+		{
+			int n;
+			do {
+				n = static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait,
+					wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+			} while (n == -1 && errno == EINTR);
+			return n == -1 ? -errno : n;
+		}
+
+		int enroll(unsigned opcode, void const* arg, unsigned count)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+		}
+
+		// calls "f" with every available completion and consumes them
+		template <class F>
+		size_t reap(F f)
+		{
+			unsigned head {*cq_head};
+			unsigned tail {__atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)};
+			size_t count {0};
+
+			for (; head != tail; ++head, ++count) {
+				f(cqes[head & cq_mask]);
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+			return count;
+		}
+
+		void release()
+		{
+			if (sqes && sqes != MAP_FAILED) {
+				munmap(sqes, sqes_len);
+			}
+			if (cq && cq != MAP_FAILED && cq != sq) {
+				munmap(cq, cq_len);
+			}
+			if (sq && sq != MAP_FAILED) {
+				munmap(sq, sq_len);
+			}
+			if (fd != -1) {
+				::close(fd);
+			}
+			sq = cq = nullptr;
+			sqes = nullptr;
+			fd = -1;
+		}
+
+		int fd {-1};
+		void* sq {nullptr};
+		void* cq {nullptr};
+		size_t sq_len {0}, cq_len {0}, sqes_len {0};
+
+		unsigned* sq_head {nullptr};
+		unsigned* sq_tail {nullptr};
+		unsigned* sq_array {nullptr};
+		unsigned sq_mask {0}, sq_entries {0};
+		io_uring_sqe* sqes {nullptr};
+
+		unsigned* cq_head {nullptr};
+		unsigned* cq_tail {nullptr};
+		unsigned cq_mask {0};
+		io_uring_cqe* cqes {nullptr};
+	};
+
+	// multishot accept arrived in Linux 5.19
+	static bool multishot_accept()
+	{
+		utsname name {};
+		int major {0}, minor {0};
+		return uname(&name) == 0 && std::sscanf(name.release, "%d.%d", &major, &minor) == 2
+			&& (major > 5 || (major == 5 && minor >= 19));
+	}
+#else
+	struct uring_t {};
+#endif
+
+	static constexpr unsigned ENGINE_ENTRIES {64};
+	static constexpr unsigned ACCEPT_ENTRIES {64};
+
+	io_engine::io_engine()
+	{
+#ifdef IO_URING
+		ring_ = std::make_unique<uring_t>(ENGINE_ENTRIES);
+		if (!ring_->valid()) {
+			ring_.reset();
+		}
+#endif
+	}
+
+	io_engine::~io_engine() = default;
+
+	bool io_engine::uring() const
+	{
+		return ring_ != nullptr;
+	}
+
+	bool io_engine::buffers([[maybe_unused]] iovec const* buffers, [[maybe_unused]] size_t count)
+	{
+#ifdef IO_URING
+		if (ring_) {
+			ring_->enroll(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+			return !count || ring_->enroll(IORING_REGISTER_BUFFERS, buffers, static_cast<unsigned>(count)) == 0;
+		}
+#endif
+		return true;
+	}
+
+	size_t io_engine::receive(io_op_t* ops, size_t count)
+	{
+		return submit(ops, count, false);
+	}
+
+	size_t io_engine::send(io_op_t* ops, size_t count)
+	{
+		return submit(ops, count, true);
+	}
+
+	/*
+	 * "submit" fills the submission ring with as many operations as fit, enters
+	 * the kernel once to submit them and wait for all of their completions, and
+	 * repeats until the batch is done. Completions carry their operation's index.
+	 */
+	size_t io_engine::submit(io_op_t* ops, size_t count, bool sending)
+	{
+		size_t done {0};
+#ifdef IO_URING
+		if (ring_) {
+			while (done < count) {
+				unsigned queued {0};
+				io_uring_sqe* sqe;
+
+				while (done + queued < count && (sqe = ring_->next())) {
+					auto& op {ops[done + queued]};
+					sqe->fd = op.fd;
+					sqe->addr = reinterpret_cast<uint64_t>(op.data);
+					sqe->len = static_cast<uint32_t>(op.size);
+					sqe->user_data = done + queued;
+					op.result = -ECANCELED;
+
+					if (op.buffer >= 0) {
+						sqe->opcode = sending ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+						sqe->buf_index = static_cast<uint16_t>(op.buffer);
+						sqe->off = static_cast<uint64_t>(-1);
+					} else {
+						sqe->opcode = sending ? IORING_OP_SEND : IORING_OP_RECV;
+						sqe->msg_flags = static_cast<uint32_t>(op.flags);
+					}
+					++queued;
+				}
+
+				unsigned submitted {0}, reaped {0};
+				while (reaped < queued) {
+					int entered {ring_->enter(queued - submitted, queued - reaped)};
+					if (entered < 0) {
+						break;
+					}
+					submitted += static_cast<unsigned>(entered);
+					reaped += ring_->reap([ops](io_uring_cqe const& cqe) {
+						ops[cqe.user_data].result = cqe.res;
+					});
+				}
+				done += queued;
+
+				// a failed ring is closed, cancelling what it holds: the thread falls back to syscalls
+				if (reaped < queued) {
+					ring_.reset();
+					break;
+				}
+			}
+		}
+#endif
+		for (; done < count; ++done) {
+			auto& op {ops[done]};
+			int flags {op.buffer >= 0 ? 0 : op.flags};
+			ssize_t n {sending ? ::send(op.fd, op.data, op.size, flags) : ::recv(op.fd, op.data, op.size, flags)};
+			op.result = n == -1 ? -errno : n;
+		}
+
+		size_t succeeded {0};
+		for (size_t i {0}; i < count; ++i) {
+			succeeded += ops[i].result >= 0;
+		}
+		return succeeded;
+	}
+
+	acceptor::acceptor()
+	{
+		flush = dispatch;
+#ifdef IO_URING
+		if (!multishot_accept()) {
+			return;
+		}
+
+		ring_ = std::make_unique<uring_t>(ACCEPT_ENTRIES);
+		event_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+		if (!ring_->valid() || event_ == -1 || ring_->enroll(IORING_REGISTER_EVENTFD, &event_, 1) != 0) {
+			ring_.reset();
+			if (event_ != -1) {
+				::close(event_);
+				event_ = -1;
+			}
+			return;
+		}
+
+		reactor::access().bind(event_, *this);
+#endif
+	}
+
+	acceptor::~acceptor()
+	{
+		if (event_ != -1) {
+			reactor::access().forget(event_);
+			::close(event_);
+		}
+	}
+
+	bool acceptor::available() const
+	{
+		return ring_ != nullptr;
+	}
+
+	bool acceptor::listen([[maybe_unused]] int fd, [[maybe_unused]] listener_t& listener)
+	{
+		if (!ring_) {
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock {m_};
+		uint64_t id {next_++};
+		listeners_.emplace(id, entry_t {fd, &listener});
+		if (!arm(fd, id)) {
+			listeners_.erase(id);
+			return false;
+		}
+		return true;
+	}
+
+	void acceptor::forget([[maybe_unused]] int fd)
+	{
+#ifdef IO_URING
+		if (!ring_) {
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock {m_};
+		for (auto it {listeners_.begin()}; it != listeners_.end(); ++it) {
+			if (it->second.fd == fd) {
+				// a listener being bound to the reactor is left to the "reactor::forget" which follows
+				if (it->second.state == state_t::BINDING) {
+					auto id {it->first};
+					handed_.wait(lock, [this, id] { return !listeners_.contains(id); });
+					return;
+				}
+
+				// completions of the cancelled accept find no listener and are dropped, 
+				// a pending listener has no accept left to cancel
+				if (it->second.state == state_t::ARMED) {
+					if (auto* sqe {ring_->next()}) {
+						sqe->opcode = IORING_OP_ASYNC_CANCEL;
+						sqe->addr = it->first;
+						sqe->user_data = 0;
+						ring_->enter(1, 0);
+					}
+				}
+				listeners_.erase(it);
+				return;
+			}
+		}
+#endif
+	}
+
+	bool acceptor::arm([[maybe_unused]] int fd, [[maybe_unused]] uint64_t id)
+	{
+#ifdef IO_URING
+		if (auto* sqe {ring_->next()}) {
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->fd = fd;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_CLOEXEC;
+			sqe->user_data = id;
+			return ring_->enter(1, 0) >= 0;
+		}
+#endif
+		return false;
+	}
+
+	// errors of one connection or of a momentary shortage, after which accepting goes on
+	[[maybe_unused]] static bool transient(int error)
+	{
+		switch (error) {
+		case EAGAIN:
+		case EINTR:
+		case ECONNABORTED:
+		case EPROTO:
+		case EMFILE:
+		case ENFILE:
+		case ENOBUFS:
+		case ENOMEM:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/*
+	 * "ready" runs on a reactor thread when the eventfd signals new completions.
+	 * A multishot accept stays armed while its completions carry IORING_CQE_F_MORE;
+	 * once one does not, it is submitted again after a success or a transient 
+	 * error. A listener the ring cannot take back is bound to the reactor by 
+	 * "dispatch", which runs without the reactor locked.
+	 */
+	void acceptor::ready(int)
+	{
+#ifdef IO_URING
+		uint64_t signals {0};
+		[[maybe_unused]] auto n {::read(event_, &signals, sizeof(signals))};
+
+		std::unique_lock<std::mutex> lock {m_};
+		ring_->reap([this](io_uring_cqe const& cqe) {
+			auto it {listeners_.find(cqe.user_data)};
+			if (it == listeners_.end()) {
+				if (cqe.user_data && cqe.res >= 0) {
+					::close(cqe.res);
+				}
+				return;
+			}
+
+			auto [fd, listener, state] {it->second};
+			if (cqe.res >= 0) {
+				listener->accepted(cqe.res);
+				if (listener->flush && std::find(flushes_.begin(), flushes_.end(), listener->flush) == flushes_.end()) {
+					flushes_.push_back(listener->flush);
+				}
+			}
+
+			if (!(cqe.flags & IORING_CQE_F_MORE)) {
+				if ((cqe.res >= 0 || transient(-cqe.res)) && arm(fd, it->first)) {
+					return;
+				}
+				it->second.state = state_t::PENDING;
+				handovers_.push_back(it->first);
+			}
+		});
+#endif
+	}
+
+	void acceptor::dispatch()
+	{
+		for (auto id : handovers_) {
+			access().handover(id);
+		}
+		handovers_.clear();
+
+		for (auto flush : flushes_) {
+			flush();
+		}
+		flushes_.clear();
+	}
+
+	/*
+	 * The reactor is called without "m_": its threads take "m_" under the 
+	 * reactor lock. "forget" waits for a binding listener instead, so the 
+	 * "reactor::forget" of a closing socket always comes after the binding.
+	 */
+	void acceptor::handover(uint64_t id)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto it {listeners_.find(id)};
+		if (it == listeners_.end()) {
+			return;
+		}
+
+		auto [fd, listener, state] {it->second};
+		it->second.state = state_t::BINDING;
+		lock.unlock();
+
+		[[maybe_unused]] bool bound {listener->fallback && reactor::access().bind(fd, *listener->fallback)};
+#ifdef DEBUG
+		if (!bound) {
+			std::cout << "Listening socket " << fd << " lost: neither the ring nor the reactor accepts on it\n";
+		}
+#endif
+
+		lock.lock();
+		listeners_.erase(id);
+		handed_.notify_all();
+	}
+
+} // namespace bluegrass
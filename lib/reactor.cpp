@@ -0,0 +1,255 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "bluegrass/reactor.hpp"
+
+namespace bluegrass {
+
+	reactor::reactor(threads_t const& threads) :
+		pool_ {threads},
+		epoll_ {epoll_create1(EPOLL_CLOEXEC)},
+		wakeup_ {eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)}
+	{
+		epoll_event event {};
+		event.events = EPOLLIN;
+		event.data.fd = wakeup_;
+
+		if (epoll_ == -1 || wakeup_ == -1 || epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &event) == -1) {
+			::close(epoll_);
+			::close(wakeup_);
+			throw std::runtime_error("Failed creating reactor");
+		}
+
+		passes_.resize(std::max<size_t>(pool_.min, 1));
+		for (size_t i {0}; i < passes_.size(); ++i) {
+			threads_.emplace_back([this, i] { run(i); });
+		}
+	}
+
+	// the wakeup event is never consumed, so it stops every I/O thread
+	reactor::~reactor()
+	{
+		uint64_t stop {1};
+		[[maybe_unused]] auto n {::write(wakeup_, &stop, sizeof(stop))};
+		for (auto& thread : threads_) {
+			thread.join();
+		}
+		::close(wakeup_);
+		::close(epoll_);
+	}
+
+	bool reactor::bind(int fd, binding_t& binding, bool oneshot)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto [it, added] {fds_.try_emplace(fd)};
+		it->second = entry_t {&binding, it->second.output, nullptr, nullptr, oneshot, false};
+		if (!arm(fd, it->second, added)) {
+			if (added) {
+				fds_.erase(it);
+			}
+			return false;
+		}
+		return true;
+	}
+
+	void reactor::bind_output(int fd, binding_t& binding)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto [it, added] {fds_.try_emplace(fd)};
+		it->second.output = &binding;
+		arm(fd, it->second, added);
+	}
+
+	void reactor::rearm(int fd)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto it {fds_.find(fd)};
+		if (it != fds_.end() && it->second.paused) {
+			it->second.paused = false;
+			arm(fd, it->second, false);
+		}
+	}
+
+	void reactor::unbind_output(int fd)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto it {fds_.find(fd)};
+		if (it == fds_.end() || !it->second.output) {
+			return;
+		}
+
+		it->second.output = nullptr;
+		if (it->second.bound) {
+			arm(fd, it->second, false);
+		} else {
+			fds_.erase(it);
+			epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+		}
+	}
+
+	void reactor::watch(waiter_t& waiter)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		auto [it, added] {fds_.try_emplace(waiter.fd)};
+		(waiter.events & EPOLLOUT ? it->second.write : it->second.read) = &waiter;
+		arm(waiter.fd, it->second, added);
+	}
+
+	/*
+	 * Work collected for "fd" may still be in a flush of another I/O thread, so 
+	 * "forget" waits for every flush in progress to finish. Flushes started later 
+	 * cannot hold work of "fd": it left the table first. The calling I/O thread 
+	 * is not waited for, it cannot be inside its own flush here.
+	 */
+	void reactor::forget(int fd)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		if (fds_.erase(fd)) {
+			epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+		}
+
+		std::vector<std::pair<size_t, uint64_t>> flushing {};
+		for (size_t i {0}; i < passes_.size(); ++i) {
+			if (i != current_ && passes_[i].flushing) {
+				flushing.emplace_back(i, passes_[i].count);
+			}
+		}
+		flushed_.wait(lock, [&] {
+			return std::all_of(flushing.begin(), flushing.end(), [this](auto const& pass) {
+				return passes_[pass.first].count != pass.second;
+			});
+		});
+	}
+
+	/*
+	 * Bound descriptors are edge triggered: each arrival is reported to one I/O 
+	 * thread, as SIGIO was, without a kernel signal queue which overflows. A 
+	 * paused one-shot binding leaves EPOLLIN out; re-arming it puts it back, and 
+	 * epoll reports input which arrived meanwhile right away. Watched descriptors 
+	 * are one-shot and re-armed while an operation is parked.
+	 */
+	bool reactor::arm(int fd, entry_t const& entry, bool added)
+	{
+		epoll_event event {};
+		if (entry.bound || entry.output) {
+			event.events = EPOLLET;
+			if (entry.bound && !entry.paused) {
+				event.events |= EPOLLIN;
+			}
+			if (entry.output) {
+				event.events |= EPOLLOUT;
+			}
+		} else {
+			event.events = EPOLLONESHOT;
+			if (entry.read) {
+				event.events |= EPOLLIN;
+			}
+			if (entry.write) {
+				event.events |= EPOLLOUT;
+			}
+		}
+		event.data.fd = fd;
+
+		// a descriptor closed without "forget" left epoll: its number may be reused
+		if (!added && epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &event) == 0) {
+			return true;
+		}
+		return (added || errno == ENOENT) && epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) == 0;
+	}
+
+	/*
+	 * "run" is an I/O thread. The events of a wakeup are sorted out under the 
+	 * lock: bindings collect their work and ready operations are taken out of 
+	 * the table. Collected work is flushed and operations are retried outside 
+	 * of it, so a resumed coroutine may park its next operation right away. 
+	 * An operation which still blocks is parked again.
+	 */
+	void reactor::run(size_t index)
+	{
+		pool_.configure(index);
+		current_ = index;
+
+		std::vector<epoll_event> events(64);
+		std::vector<std::pair<waiter_t*, bool>> ready {};
+		std::vector<void (*)()> flushes {};
+
+		while (true) {
+			int count {epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), -1)};
+
+			{
+				std::unique_lock<std::mutex> lock {m_};
+				for (int i {0}; i < count; ++i) {
+					int fd {events[i].data.fd};
+					if (fd == wakeup_) {
+						return;
+					}
+
+					auto it {fds_.find(fd)};
+					if (it == fds_.end()) {
+						continue;
+					}
+
+					auto& entry {it->second};
+					uint32_t flags {events[i].events};
+					bool failed {(flags & (EPOLLERR | EPOLLHUP)) != 0};
+
+					// a pure output edge is not input, errors are reported to both bindings; 
+					// a one-shot binding is paused before another thread can see its next edge
+					if (entry.bound || entry.output) {
+						auto input {flags != EPOLLOUT && !entry.paused ? entry.bound : nullptr};
+						if (input && entry.oneshot) {
+							entry.paused = true;
+							arm(fd, entry, false);
+						}
+						for (auto binding : {input, failed || flags & EPOLLOUT ? entry.output : nullptr}) {
+							if (!binding) {
+								continue;
+							}
+							binding->ready(fd);
+							auto flush {binding->flush};
+							if (flush && std::find(flushes.begin(), flushes.end(), flush) == flushes.end()) {
+								flushes.push_back(flush);
+							}
+						}
+						continue;
+					}
+
+					if (entry.read && (failed || flags & EPOLLIN)) {
+						ready.emplace_back(std::exchange(entry.read, nullptr), failed);
+					}
+					if (entry.write && (failed || flags & EPOLLOUT)) {
+						ready.emplace_back(std::exchange(entry.write, nullptr), failed);
+					}
+					if (entry.read || entry.write) {
+						arm(fd, entry, false);
+					}
+				}
+				passes_[index].flushing = !flushes.empty();
+			}
+
+			for (auto flush : flushes) {
+				flush();
+			}
+			if (!flushes.empty()) {
+				std::unique_lock<std::mutex> lock {m_};
+				passes_[index] = {passes_[index].count + 1, false};
+				flushed_.notify_all();
+			}
+			flushes.clear();
+
+			for (auto [waiter, failed] : ready) {
+				// a failed descriptor resumes the operation with its error instead of re-parking
+				if (waiter->attempt() || failed) {
+					scheduler::resume(waiter->sched, waiter->handle);
+				} else {
+					watch(*waiter);
+				}
+			}
+			ready.clear();
+		}
+	}
+
+} // namespace bluegrass
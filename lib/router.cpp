@@ -1,23 +1,23 @@
+#include <cerrno>
+#include <array>
 #include <vector>
 
 #include "bluegrass/router.hpp"
 
 namespace bluegrass {
 	
-	router::router(uint16_t port, size_t max_neighbors, size_t thread_count) :
-		addr_ {hci::access().self()},
+	router::router(uint16_t port, size_t max_neighbors, threads_t const& threads, compression_t const& compression) :
+		addr_ {transport::current().self()},
 		port_ {port},
-		service_ {[&](socket& conn){ connection(conn); }, thread_count},
-		server_ {ANY, port_, service_, async_t::SERVER},
-		length_ {NET_LEN}
+		compression_ {compression},
+		service_ {[&](socket& conn){ connection(conn); }, threads},
+		server_ {ANY, port_, service_, async_t::SERVER, classify}
 	{
-		// allocate trigger buffer
-		buffer_ = std::make_unique<uint8_t*>(static_cast<uint8_t*>(::operator new[](length_)));
 #ifdef DEBUG
 		std::cout << addr_ << "\tFinding neighbors\n";
 #endif
 		std::vector<bdaddr_t> neighbors {};
-		hci::access().inquiry(max_neighbors, neighbors);
+		transport::current().discover(max_neighbors, neighbors);
 #ifdef DEBUG
 		std::cout << addr_ << "\tFound " << neighbors.size() << " neighbors\n";
 #endif
@@ -27,12 +27,43 @@ namespace bluegrass {
 #ifdef DEBUG
 				std::cout << addr_ << "\tNeighbor detected " << addr << std::endl;
 #endif
-				const async_socket& neighbor {*(clients_.emplace(addr, port_, service_, async_t::CLIENT).first)};
-				network_t packet {utility_t::ONBOARD, 0, NET_LEN, 0};
-				neighbor.send(&packet);
+				// onboarding reads the answer here: the neighbor is handed to the reactor only afterwards, 
+				// so no service thread takes its packets for new connections
+				socket conn {addr, port_};
+				network_t request {utility_t::ONBOARD, 0, NET_LEN, offered()};
+				conn.send(&request);
 
-				// receive all the services held by the neighbor
-				while (neighbor.receive(&packet) && packet.info.utility == utility_t::ONBOARD) {
+				// receive all the services held by the neighbor, as many per call as are queued
+				std::vector<network_t> services {};
+				std::array<network_t, 16> packets {};
+				std::array<ssize_t, 16> lengths {};
+				uint8_t offers {0};
+				bool onboarding {true};
+				for (size_t n; onboarding && (n = conn.receive_many(packets.data(), packets.size(), lengths.data()));) {
+					for (size_t i {0}; i < n; ++i) {
+						auto const& packet {packets[i]};
+						// a neighbor which hung up leaves empty entries: stale packets are never read
+						if (lengths[i] != static_cast<ssize_t>(sizeof(network_t))) {
+							onboarding = false;
+							break;
+						}
+						// the terminator carries the codecs the neighbor offers
+						if (packet.info.utility != utility_t::ONBOARD) {
+							offers = packet.payload;
+							onboarding = false;
+							break;
+						}
+						services.push_back(packet);
+					}
+				}
+
+				const async_socket& neighbor {*(clients_.emplace(std::move(conn), service_, async_t::CLIENT, classify).first)};
+				if (offered() & offers) {
+					std::unique_lock<std::mutex> lock {m_};
+					compressing_.insert(&neighbor);
+				}
+
+				for (auto& packet : services) {
 					++packet.payload;
 					auto route {routes_.find(packet.info.service)};
 #ifdef DEBUG
@@ -87,66 +118,180 @@ namespace bluegrass {
 #endif
 		++packet.payload;
 
-		// forward packet which caused route change
-		for (auto it {clients_.begin()}; it != clients_.end();) {
-			if (it->send(&packet)) {
+		std::vector<uint8_t> lost {};
+		std::unique_lock<std::mutex> lock {m_};
+
+		// forward packet which caused route change to every neighbor in one batch, 
+		// a neighbor with packets still queued gets it queued behind them
+		std::vector<io_op_t> sends {};
+		std::vector<sent_t> outcomes(clients_.size(), sent_t::SENT);
+		std::vector<bool> batched(clients_.size(), false);
+		sends.reserve(clients_.size());
+
+		size_t i {0};
+		for (auto const& client : clients_) {
+			auto queue {queues_.find(&client)};
+			if (queue != queues_.end() && queue->second.queued()) {
+				outcomes[i] = queue->second.send(&packet);
+			} else {
+				sends.push_back(client.send_op(&packet));
+				batched[i] = true;
+			}
+			++i;
+		}
+		io_engine::local().send(sends.data(), sends.size());
+
+		// a full socket is congestion, not a lost neighbor: the packet waits in its queue
+		auto sent {sends.begin()};
+		i = 0;
+		for (auto const& client : clients_) {
+			if (batched[i]) {
+				if (sent->result == -EAGAIN) {
+					outcomes[i] = queues_.try_emplace(&client, client).first->second.send(&packet);
+				} else if (sent->result < 0) {
+					outcomes[i] = sent_t::FAILED;
+				}
+				++sent;
+			}
+			++i;
+		}
+
+		auto outcome {outcomes.begin()};
+		for (auto it {clients_.begin()}; it != clients_.end(); ++outcome) {
+			if (*outcome != sent_t::FAILED) {
+#ifdef DEBUG
+				if (*outcome == sent_t::CONGESTED) {
+					std::cout << addr_ << "\tCongested neighbor dropped notification\n";
+				}
+#endif
 				++it;
 			} else {
 #ifdef DEBUG
 				std::cout << addr_ << "\tLost neighbor detected\n";
 #endif
-				std::vector<uint8_t> lost {};
 				for (auto route {routes_.begin()}; route != routes_.end();) {
 					if (route->second.conn != *it) {
-						++it;
+						++route;
 					} else {
 						lost.push_back(route->first);
 						route = routes_.erase(route);
 					}
 				}
-
-				// erase after finding all lost services to prevent inf recursion
+				queues_.erase(&*it);
+				compressing_.erase(&*it);
 				it = clients_.erase(it);
-
-				for (auto s : lost) {
-					notify(network_t{utility_t::SUSPEND, s, NET_LEN, 0});
-				}
 			}
 		}
+
+		lock.unlock();
+
+		// suspend after erasing all lost neighbors to prevent inf recursion
+		for (auto s : lost) {
+			notify(network_t{utility_t::SUSPEND, s, NET_LEN, 0});
+		}
+	}
+
+	bool router::trigger(uint8_t service, std::span<const std::byte> payload)
+	{
+		auto route {routes_.find(service)};
+		if (!available(route) || payload.size() > UINT8_MAX) {
+			return false;
+		}
+
+		return deliver(route->second, {utility_t::TRIGGER, service, static_cast<uint8_t>(payload.size())}, payload);
 	}
 
 	void router::trigger(socket const& conn, uint8_t length, uint8_t service)
 	{
-		// reallocate trigger buffer if needed
-		if (length_ < length) {
-			buffer_ = std::make_unique<uint8_t*>(static_cast<uint8_t*>(::operator new[](length)));
-			length_ = length;
+		// every forwarded message checks out its own buffer: concurrent service threads share none
+		auto buffer {buffer_pool::access().acquire(length)};
+
+		// the payload is scattered straight into the buffer it is forwarded from, 
+		// MSG_TRUNC reports the real length so a datagram longer than its header says is dropped
+		header_t info {};
+		if (conn.receivev(&info, buffer.span(), MSG_TRUNC) != length) {
+			return;
+		}
+
+		auto route {routes_.find(service)};
+		if (available(route)) {
+			deliver(route->second, info, buffer.span());
+		}
+	}
+
+	/*
+	 * Payloads are compressed or decompressed only where the codec changes 
+	 * between hops: a compressed payload passes compressing neighbors as is.
+	 */
+	bool router::deliver(service_t const& route, header_t info, std::span<const std::byte> payload)
+	{
+		auto const& next {route.conn};
+		std::unique_lock<std::mutex> lock {m_};
+		bool compressing {compressing_.contains(&next)};
+		lock.unlock();
+		buffer_t buffer {};
+
+		if (info.utility == utility_t::TRIGGER_LZ && !compressing) {
+			buffer = buffer_pool::access().acquire(UINT8_MAX);
+			ssize_t n {lz_decompress(payload, buffer.span())};
+			if (n < 0) {
+				return false;
+			}
+			info = {utility_t::TRIGGER, info.service, static_cast<uint8_t>(n)};
+			payload = buffer.span().first(n);
+		} else if (info.utility == utility_t::TRIGGER && compressing && !payload.empty() && payload.size() >= compression_.threshold) {
+			// only output smaller than the payload is worth sending
+			buffer = buffer_pool::access().acquire(payload.size() - 1);
+			if (size_t n {lz_compress(payload, buffer.span())}) {
+				info = {utility_t::TRIGGER_LZ, info.service, static_cast<uint8_t>(n)};
+				payload = buffer.span().first(n);
+			}
+		}
+
+		// the payload is gathered from its buffer behind its header, never copied into a packet; 
+		// a local service has no queue: "route.steps" is 0 and its socket is not owned here
+		if (!route.steps) {
+			return next.sendv(&info, payload);
+		}
+
+		lock.lock();
+		auto queue {queues_.find(&next)};
+		if (queue == queues_.end() || !queue->second.queued()) {
+			if (next.sendv(&info, payload)) {
+				return true;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				return false;
+			}
+			queue = queues_.try_emplace(&next, next).first;
 		}
 
-		// TODO: buffer overflow vector test this
-		conn.receive(*buffer_, length);
-		
-		auto route {routes_.find(service)->second};
-		route.conn.send(*buffer_, length);
+		auto sent {queue->second.send(&info, payload)};
+		return sent == sent_t::SENT || sent == sent_t::QUEUED;
+	}
+
+	uint8_t router::offered() const
+	{
+		return compression_.enabled ? static_cast<uint8_t>(offer(codec_t::LZ)) : 0;
 	}
 
-	void router::onboard(socket const& conn, network_t packet)
+	void router::onboard(socket const& conn)
 	{
 #ifdef DEBUG
 		std::cout << addr_ << "\tNew connection for onboard service\n";
 #endif
-		// send packets to new router containing service info
+		// send packets to new router containing service info, all in one batch
+		std::vector<network_t> packets {};
+		packets.reserve(routes_.size() + 1);
 		for (auto const& route : routes_) {
 #ifdef DEBUG
 			std::cout << addr_ << "\tForwarding service " << (int) route.first << " to new neighbor device\n";
 #endif
-			packet = {{utility_t::ONBOARD, route.first, NET_LEN}, route.second.steps};
-			conn.send(&packet);
+			packets.push_back({{utility_t::ONBOARD, route.first, NET_LEN}, route.second.steps});
 		}
 
-		packet.info = header_t {utility_t::SUSPEND, 0, 0};
-		packet.payload = 0;
-		conn.send(&packet);
+		packets.push_back({{utility_t::SUSPEND, 0, 0}, offered()});
+		conn.send_many(packets.data(), packets.size());
 	}
 
 	void router::publish(socket const& conn, network_t packet) 
@@ -190,29 +335,62 @@ namespace bluegrass {
 		}
 	}
 
+	/*
+	 * A client is enqueued once for every packet which arrived together, so every 
+	 * packet queued on the connection is handled, then the client is re-armed. 
+	 * Only the first wait blocks: a connection fresh from "accept" has no packet yet.
+	 */
 	void router::connection(socket& conn)
 	{
 		header_t info {};
-		conn.receive(&info, MSG_PEEK);
+		for (int flags {MSG_PEEK};; flags |= MSG_DONTWAIT) {
+			errno = 0;
+			size_t length {conn.receive(std::as_writable_bytes(std::span {&info, 1}), flags)};
+			if (!length) {
+				// a closed connection is not re-armed: it would be reported again right away
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					async_socket::rearm(conn);
+				}
+				return;
+			}
+			if (length < sizeof(info)) {
+				conn.receive(std::as_writable_bytes(std::span {&info, 1}));
+				continue;
+			}
+
+			if (info.utility == utility_t::TRIGGER || info.utility == utility_t::TRIGGER_LZ) {
+				trigger(conn, info.length, info.service);
+				continue;
+			}
 
-		if (info.utility == utility_t::TRIGGER) {
-			trigger(conn, info.length, info.service);
-		} else {
 			network_t packet;
 			conn >> &packet;
 
 			if (info.utility == utility_t::ONBOARD) {
-				onboard(conn, packet);
-				// onboard connections are from "accept" calls: safe to move into the network
-				clients_.emplace(std::move(conn), service_, async_t::CLIENT);
+				onboard(conn);
+				// onboard connections are from "accept" calls: safe to move into the network, 
+				// packets behind the ONBOARD wake the new client
+				auto client {clients_.emplace(std::move(conn), service_, async_t::CLIENT, classify).first};
+				if (offered() & packet.payload) {
+					std::unique_lock<std::mutex> lock {m_};
+					compressing_.insert(&*client);
+				}
+				return;
 			} else if (info.utility == utility_t::PUBLISH) {
 				publish(conn, packet);
 			} else if (info.utility == utility_t::SUSPEND) {
 				suspend(packet);
 			}
 		}
+	}
 
-		// conn is purposely not closed
+	size_t router::classify(socket const& conn)
+	{
+		header_t info {};
+		if (conn.receive(&info, MSG_PEEK | MSG_DONTWAIT) && (info.utility == utility_t::TRIGGER || info.utility == utility_t::TRIGGER_LZ)) {
+			return 1;
+		}
+		return 0;
 	}
 
 } // namespace bluegrass
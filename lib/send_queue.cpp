@@ -0,0 +1,124 @@
+#include <algorithm>
+
+#include "bluegrass/send_queue.hpp"
+
+namespace bluegrass {
+
+	// output edges arrive from the moment of binding: a datagram queued after it is never missed
+	send_queue::send_queue(socket const& conn, watermarks_t const& marks) :
+		conn_ {conn},
+		marks_ {marks}
+	{
+		reactor::access().bind_output(conn_.handle_, *this);
+	}
+
+	// after "unbind_output" returns no reactor thread is inside "ready"
+	send_queue::~send_queue()
+	{
+		reactor::access().unbind_output(conn_.handle_);
+	}
+
+	sent_t send_queue::send(std::span<const std::byte> datagram)
+	{
+		iovec buffer {(void*) datagram.data(), datagram.size()};
+		return send(std::span<const iovec> {&buffer, 1});
+	}
+
+	/*
+	 * A datagram only goes straight to the socket while nothing is queued, so
+	 * datagrams leave in the order they were sent.
+	 */
+	sent_t send_queue::send(std::span<const iovec> buffers)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		if (failed_) {
+			return sent_t::FAILED;
+		}
+		if (congested_) {
+			return sent_t::CONGESTED;
+		}
+
+		if (queue_.empty()) {
+			if (conn_.sendv(buffers)) {
+				return sent_t::SENT;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				failed_ = true;
+				relieved_.notify_all();
+				return sent_t::FAILED;
+			}
+		}
+
+		size_t size {0};
+		for (auto const& part : buffers) {
+			size += part.iov_len;
+		}
+
+		auto buffer {buffer_pool::access().acquire(size)};
+		auto data {buffer.data()};
+		for (auto const& part : buffers) {
+			auto bytes {static_cast<const std::byte*>(part.iov_base)};
+			data = std::copy(bytes, bytes + part.iov_len, data);
+		}
+		queue_.push_back(std::move(buffer));
+		bytes_ += size;
+		congested_ = bytes_ >= marks_.high;
+
+		// the socket may have drained between the failed send and the push, or failed since
+		drain();
+		return failed_ ? sent_t::FAILED : sent_t::QUEUED;
+	}
+
+	size_t send_queue::queued() const
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return bytes_;
+	}
+
+	bool send_queue::congested() const
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return congested_;
+	}
+
+	bool send_queue::failed() const
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return failed_;
+	}
+
+	bool send_queue::wait(std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return relieved_.wait_for(lock, timeout, [this] { return !congested_ || failed_; }) && !failed_;
+	}
+
+	void send_queue::drain()
+	{
+		while (!queue_.empty()) {
+			if (!conn_.send(queue_.front().span())) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					failed_ = true;
+					queue_.clear();
+					bytes_ = 0;
+					relieved_.notify_all();
+				}
+				return;
+			}
+
+			bytes_ -= queue_.front().size();
+			queue_.pop_front();
+			if (congested_ && bytes_ <= marks_.low) {
+				congested_ = false;
+				relieved_.notify_all();
+			}
+		}
+	}
+
+	void send_queue::ready(int)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		drain();
+	}
+
+} // namespace bluegrass
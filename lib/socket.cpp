@@ -1,11 +1,13 @@
+#include <algorithm>
+
 #include "bluegrass/socket.hpp"
 
 namespace bluegrass {
 
-	socket::socket(bdaddr_t addr, uint16_t port)
+	socket::socket(bdaddr_t addr, uint16_t port, link_options_t const& options)
 	{
-		auto peer {setup(addr, port)};
-		if (handle_ == -1 || c_connect(handle_, (const struct sockaddr*) &peer, sizeof(peer)) == -1) {
+		auto& link {setup()};
+		if (handle_ == -1 || (link.l2cap() && !configure(options)) || link.connect(handle_, addr, port) == -1) {
 			c_close(handle_);
 			throw std::runtime_error("Failed creating client_socket");
 		}
@@ -47,14 +49,248 @@ namespace bluegrass {
 		}
 	}
 
-	sockaddr_l2 socket::setup(bdaddr_t addr, uint16_t port) 
+	bool socket::send(std::span<const std::byte> data, int flags) const
 	{
-		sockaddr_l2 peer {};
-		handle_ = c_socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
-		peer.l2_family = AF_BLUETOOTH;
-		peer.l2_psm = htobs(port);			
-		bacpy(&peer.l2_bdaddr, &addr);
-		return peer;
+		if (handle_ != -1) {
+			return c_send(handle_, data.data(), data.size(), flags | MSG_DONTWAIT) != -1;
+		}
+		return false;
+	}
+
+	// MSG_TRUNC makes the kernel return the datagram length rather than the bytes copied
+	size_t socket::receive(std::span<std::byte> data, int flags) const
+	{
+		if (handle_ != -1) {
+			iovec buffer {data.data(), data.size()};
+			msghdr message {};
+			message.msg_iov = &buffer;
+			message.msg_iovlen = 1;
+
+			ssize_t n {recvmsg(handle_, &message, flags | MSG_TRUNC)};
+			if (n == -1) {
+				return 0;
+			}
+			// protocols which ignore the flag still mark a truncated datagram, but not its length
+			if ((message.msg_flags & MSG_TRUNC) && static_cast<size_t>(n) <= data.size()) {
+				return data.size() + 1;
+			}
+			return n;
+		}
+		return 0;
+	}
+
+	buffer_t socket::receive_buffer(int flags) const
+	{
+		auto buffer {peek(flags)};
+		if (!buffer || receive(buffer.span(), flags) != buffer.size()) {
+			return {};
+		}
+		return buffer;
+	}
+
+	size_t socket::pending(int flags) const
+	{
+		return peek(flags).size();
+	}
+
+	/*
+	 * Protocols which ignore MSG_TRUNC mark a truncated datagram without its length,
+	 * so the datagram is peeked into ever larger buffers until it fits. It is never
+	 * consumed here: a mismatch loses nothing.
+	 */
+	buffer_t socket::peek(int flags) const
+	{
+		for (size_t size {1};;) {
+			auto buffer {buffer_pool::access().acquire(size)};
+			buffer.resize(buffer.capacity());
+
+			size_t length {receive(buffer.span(), flags | MSG_PEEK)};
+			if (!length) {
+				return {};
+			}
+			if (length <= buffer.size()) {
+				buffer.resize(length);
+				return buffer;
+			}
+			size = std::max(length, 2 * buffer.size());
+		}
+	}
+
+	// sends like "send": never blocks on a full socket
+	bool socket::sendv(std::span<const iovec> buffers, int flags) const
+	{
+		if (handle_ != -1) {
+			msghdr message {};
+			message.msg_iov = const_cast<iovec*>(buffers.data());
+			message.msg_iovlen = buffers.size();
+			return sendmsg(handle_, &message, flags | MSG_DONTWAIT) != -1;
+		}
+		return false;
+	}
+
+	ssize_t socket::receivev(std::span<const iovec> buffers, int flags) const
+	{
+		if (handle_ != -1) {
+			msghdr message {};
+			message.msg_iov = const_cast<iovec*>(buffers.data());
+			message.msg_iovlen = buffers.size();
+			return recvmsg(handle_, &message, flags);
+		}
+		return -1;
+	}
+
+	/*
+	 * Datagrams are moved in order, so a batch stops at the first failure: the 
+	 * failed datagram and every later one report its errno. A short receive batch 
+	 * means the socket is drained, and the rest report EAGAIN.
+	 */
+	size_t socket::transfer_many(bool sending, void* data, size_t size, size_t count, ssize_t* results, int flags) const
+	{
+		constexpr size_t BATCH {64};
+		mmsghdr messages[BATCH];
+		iovec buffers[BATCH];
+
+		size_t done {0};
+		int error {handle_ == -1 ? EBADF : 0};
+		while (!error && done < count) {
+			size_t n {std::min(count - done, BATCH)};
+			for (size_t i {0}; i < n; ++i) {
+				buffers[i] = {static_cast<char*>(data) + (done + i) * size, size};
+				messages[i] = {};
+				messages[i].msg_hdr.msg_iov = &buffers[i];
+				messages[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			int moved {sending ? sendmmsg(handle_, messages, n, flags) : recvmmsg(handle_, messages, n, flags, nullptr)};
+			if (moved == -1) {
+				error = errno;
+				break;
+			}
+
+			for (size_t i {0}; results && i < static_cast<size_t>(moved); ++i) {
+				results[done + i] = messages[i].msg_len;
+			}
+			done += moved;
+
+			if (!sending) {
+				if (static_cast<size_t>(moved) < n) {
+					error = EAGAIN;
+				}
+				// only the first datagram of the call is waited for
+				if (flags & MSG_WAITFORONE) {
+					flags |= MSG_DONTWAIT;
+				}
+			}
+		}
+
+		for (size_t i {done}; results && i < count; ++i) {
+			results[i] = -error;
+		}
+		return done;
+	}
+
+	transport& socket::setup() 
+	{
+		auto& link {transport::current()};
+		handle_ = link.open();
+		return link;
+	}
+
+	// maps channel modes between "channel_t" and the L2CAP_OPTIONS and BT_MODE values
+	static constexpr uint8_t L2CAP_MODES[] {0, L2CAP_MODE_BASIC, L2CAP_MODE_ERTM, L2CAP_MODE_STREAMING};
+#ifdef BT_MODE
+	static constexpr uint8_t BT_MODES[] {0, BT_MODE_BASIC, BT_MODE_ERTM, BT_MODE_STREAMING};
+#endif
+
+	template <size_t N>
+	static channel_t to_channel(uint8_t const (&modes)[N], uint8_t mode)
+	{
+		for (size_t i {1}; i < N; ++i) {
+			if (modes[i] == mode) {
+				return static_cast<channel_t>(i);
+			}
+		}
+		return channel_t::DEFAULT;
+	}
+
+	/*
+	 * BR/EDR links take the MTUs, flush timeout and mode in one L2CAP_OPTIONS. Where 
+	 * the kernel refuses it, the MTU and mode are set as the separate Bluetooth 
+	 * options instead; those have no flush timeout and the peer decides the 
+	 * outgoing MTU, so requesting either fails.
+	 */
+	bool socket::configure(link_options_t const& options)
+	{
+		bool result {true};
+		auto mode {static_cast<size_t>(options.mode)};
+
+		if (options.imtu || options.omtu || options.flush_to || options.mode != channel_t::DEFAULT) {
+			l2cap_options l2 {};
+			socklen_t length {sizeof(l2)};
+			bool legacy {getsockopt(handle_, SOL_L2CAP, L2CAP_OPTIONS, &l2, &length) == 0};
+			if (legacy) {
+				l2.imtu = options.imtu ? options.imtu : l2.imtu;
+				l2.omtu = options.omtu ? options.omtu : l2.omtu;
+				l2.flush_to = options.flush_to ? options.flush_to : l2.flush_to;
+				l2.mode = mode ? L2CAP_MODES[mode] : l2.mode;
+				legacy = setsockopt(handle_, SOL_L2CAP, L2CAP_OPTIONS, &l2, sizeof(l2)) == 0;
+			}
+
+			if (!legacy) {
+				result = !options.omtu && !options.flush_to;
+				if (options.imtu) {
+					result = result && setsockopt(handle_, SOL_BLUETOOTH, BT_RCVMTU, &options.imtu, sizeof(options.imtu)) == 0;
+				}
+				if (mode) {
+#ifdef BT_MODE
+					result = result && setsockopt(handle_, SOL_BLUETOOTH, BT_MODE, &BT_MODES[mode], sizeof(uint8_t)) == 0;
+#else
+					result = false;
+#endif
+				}
+			}
+		}
+
+		if (options.sndbuf) {
+			result = result && setsockopt(handle_, SOL_SOCKET, SO_SNDBUF, &options.sndbuf, sizeof(int)) == 0;
+		}
+		if (options.rcvbuf) {
+			result = result && setsockopt(handle_, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, sizeof(int)) == 0;
+		}
+		return result;
+	}
+
+	link_options_t socket::link() const
+	{
+		link_options_t options {};
+		l2cap_options l2 {};
+		socklen_t length {sizeof(l2)};
+
+		if (getsockopt(handle_, SOL_L2CAP, L2CAP_OPTIONS, &l2, &length) == 0) {
+			options.imtu = l2.imtu;
+			options.omtu = l2.omtu;
+			options.flush_to = l2.flush_to;
+			options.mode = to_channel(L2CAP_MODES, l2.mode);
+		} else {
+			length = sizeof(uint16_t);
+			getsockopt(handle_, SOL_BLUETOOTH, BT_RCVMTU, &options.imtu, &length);
+			length = sizeof(uint16_t);
+			getsockopt(handle_, SOL_BLUETOOTH, BT_SNDMTU, &options.omtu, &length);
+#ifdef BT_MODE
+			uint8_t mode {};
+			length = sizeof(mode);
+			if (getsockopt(handle_, SOL_BLUETOOTH, BT_MODE, &mode, &length) == 0) {
+				options.mode = to_channel(BT_MODES, mode);
+			}
+#endif
+		}
+
+		// the kernel reports the doubled buffer sizes it reserves
+		length = sizeof(int);
+		getsockopt(handle_, SOL_SOCKET, SO_SNDBUF, &options.sndbuf, &length);
+		length = sizeof(int);
+		getsockopt(handle_, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, &length);
+		return options;
 	}
 
 	scoped_socket::scoped_socket(socket&& s) : socket {std::move(s)} {}
@@ -64,82 +300,123 @@ namespace bluegrass {
 		close(); 
 	}
 
-	async_socket::async_socket(bdaddr_t addr, uint16_t port, service_handle& svc, async_t type)
+	async_socket::async_socket(bdaddr_t addr, uint16_t port, service_handle& svc, async_t type, classify_t classify, link_options_t const& options)
 	{
 		int flag {};
-		auto peer {setup(addr, port)};
+		auto& link {setup()};
 
-		if (handle_ == -1) {
+		if (handle_ == -1 || (link.l2cap() && !configure(options))) {
 			c_close(handle_);
 			throw std::runtime_error("Failed creating client_socket");
 		}
 
 		// create and register the server socket
 		if (type == async_t::SERVER) {			
-			flag |= c_bind(handle_, (const struct sockaddr*) &peer, sizeof(peer));
+			flag |= link.bind(handle_, addr, port);
 			flag |= c_listen(handle_, 4);
 		} else {
-			flag |= c_connect(handle_, (const struct sockaddr*) &peer, sizeof(peer));
+			flag |= link.connect(handle_, addr, port);
 		}
 
-		services_.emplace(handle_, comm_group{type, svc});
+		group_ = std::make_unique<comm_group>(type, svc, classify);
 		async(flag);
 	}
 
-	async_socket::async_socket(socket&& client, service_handle& svc, async_t type) : socket{std::move(client)}
+	async_socket::async_socket(socket&& client, service_handle& svc, async_t type, classify_t classify) : 
+		socket{std::move(client)},
+		group_ {std::make_unique<comm_group>(type, svc, classify)}
 	{
-		services_.emplace(handle_, comm_group{type, svc});
 		async(0);
 	}
 
-	// uninstalls SIGIO and removes socket from sigio map
+	// unbinds the socket before closing it: the reactor and acceptor hold no stale binding
 	async_socket::~async_socket()
 	{
-		fcntl(handle_, F_SETSIG, 0);
-		services_.erase(handle_);
+		if (handle_ != -1) {
+			if (group_->type == async_t::SERVER) {
+				acceptor::access().forget(handle_);
+			}
+			reactor::access().forget(handle_);
+		}
 		close();
 	}
 
 	void async_socket::async(int flag)
 	{
-		struct sigaction action {};
-
-		// setup SIGIO on the server socket file descriptor
-		action.sa_sigaction = sigio;
-		action.sa_flags = SA_SIGINFO;
-		flag |= sigaction(SIGIO, &action, NULL);
-		flag |= fcntl(handle_, F_SETFL, O_ASYNC | O_NONBLOCK);
-		flag |= fcntl(handle_, F_SETOWN, getpid());
-		flag |= fcntl(handle_, F_SETSIG, SIGIO);
+		flag |= fcntl(handle_, F_SETFL, O_NONBLOCK);
 		
 		if (flag == -1) {
-			services_.erase(handle_);
 			c_close(handle_);
 			throw std::runtime_error("Failed creating async_socket");
 		}
+
+		if (group_->type != async_t::SERVER || !acceptor::access().listen(handle_, *group_)) {
+			reactor::access().bind(handle_, *group_, group_->type == async_t::CLIENT);
+		}
 	}
-		
+
+	void async_socket::rearm(socket const& conn)
+	{
+		reactor::access().rearm(conn.handle_);
+	}
+
+	async_socket::comm_group::comm_group(async_t t, service_handle& s, classify_t c) : 
+		type {t}, svc {s}, classify {c}
+	{
+		reactor::binding_t::flush = dispatch;
+		acceptor::listener_t::flush = dispatch;
+		acceptor::listener_t::fallback = this;
+	}
+
 	/*
-	 * "sigio" is the global handler installed to SIGIO signals on "server" sockets. 
-	 * "server" sockets are mapped to services which allow for multiple open sockets. 
-	 * However, a single signal handler must be used for all SIGIO signals. 
-	 * The correct queue for the signaling socket must be found be traversing the map.
+	 * "ready" runs on a reactor thread for every input edge. One edge on a "server" 
+	 * socket may stand for several connections, so clients are accepted until the 
+	 * backlog is empty.
 	 */
-	void async_socket::sigio([[maybe_unused]] int signal, siginfo_t* info, [[maybe_unused]] void* context) 
+	void async_socket::comm_group::ready(int fd)
 	{
-		auto handle {services_.at(info->si_fd)};
-		
-		if (std::get<0>(handle) == async_t::SERVER) {
-			socket temp {c_accept(info->si_fd, NULL, NULL)};
-			// make queue_size large enough to prevent blocking in interrupt
-			std::get<1>(handle).enqueue(temp);
+		if (type == async_t::SERVER) {
+			for (int client; (client = c_accept(fd, NULL, NULL)) != -1;) {
+				collect(socket {client});
+			}
 		} else {
-			socket temp {info->si_fd};
-			// make queue_size large enough to prevent blocking in interrupt
-			std::get<1>(handle).enqueue(temp);
+			collect(socket {fd});
 		}
 	}
 
-	std::map<int, std::pair<async_t, async_socket::service_handle&>> async_socket::services_;
+	void async_socket::comm_group::accepted(int client)
+	{
+		collect(socket {client});
+	}
+
+	void async_socket::comm_group::collect(socket&& conn)
+	{
+		size_t level {classify ? classify(conn) : UNLEVELED};
+		auto batch {std::find_if(batches_.begin(), batches_.end(), [&](batch_t const& b) {
+			return b.svc == &svc && b.level == level;
+		})};
+
+		if (batch == batches_.end()) {
+			batch = batches_.insert(batches_.end(), batch_t {&svc, level, {}});
+		}
+		batch->sockets.push_back(std::move(conn));
+	}
+
+	// batches are kept between wakeups so their buffers are reused
+	void async_socket::comm_group::dispatch()
+	{
+		for (auto& batch : batches_) {
+			if (batch.sockets.empty()) {
+				continue;
+			}
+
+			if (batch.level == UNLEVELED) {
+				batch.svc->enqueue_bulk(batch.sockets);
+			} else {
+				batch.svc->enqueue_bulk(batch.sockets, batch.level);
+			}
+			batch.sockets.clear();
+		}
+	}
 
 } // namespace bluegrass
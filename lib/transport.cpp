@@ -0,0 +1,174 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "bluegrass/hci.hpp"
+#include "bluegrass/transport.hpp"
+
+namespace bluegrass {
+
+	static std::atomic<transport*>& selected()
+	{
+		static bluetooth_transport bluetooth_ {};
+		static std::atomic<transport*> selected_ {&bluetooth_};
+		return selected_;
+	}
+
+	transport& transport::current()
+	{
+		return *selected().load();
+	}
+
+	void transport::use(transport& next)
+	{
+		selected() = &next;
+	}
+
+	int bluetooth_transport::open() const
+	{
+		return c_socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
+	}
+
+	static sockaddr_l2 l2cap_address(bdaddr_t addr, uint16_t port)
+	{
+		sockaddr_l2 peer {};
+		peer.l2_family = AF_BLUETOOTH;
+		peer.l2_psm = htobs(port);
+		bacpy(&peer.l2_bdaddr, &addr);
+		return peer;
+	}
+
+	int bluetooth_transport::connect(int fd, bdaddr_t addr, uint16_t port) const
+	{
+		auto peer {l2cap_address(addr, port)};
+		return c_connect(fd, (const struct sockaddr*) &peer, sizeof(peer));
+	}
+
+	int bluetooth_transport::bind(int fd, bdaddr_t addr, uint16_t port) const
+	{
+		auto local {l2cap_address(addr, port)};
+		return c_bind(fd, (const struct sockaddr*) &local, sizeof(local));
+	}
+
+	bool bluetooth_transport::l2cap() const
+	{
+		return true;
+	}
+
+	bdaddr_t bluetooth_transport::self() const
+	{
+		return hci::access().self();
+	}
+
+	void bluetooth_transport::discover(size_t max, std::vector<bdaddr_t>& devices) const
+	{
+		hci::access().inquiry(max, devices);
+	}
+
+	unix_transport::unix_transport(bdaddr_t self, std::string directory) :
+		directory_ {std::move(directory)},
+		self_ {self}
+	{
+		mkdir(directory_.c_str(), 0700);
+	}
+
+	int unix_transport::open() const
+	{
+		return c_socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	}
+
+	// addresses are written most significant byte first, as "operator<<" prints them
+	std::string unix_transport::path(bdaddr_t addr, uint16_t port) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/%02X%02X%02X%02X%02X%02X.%04X",
+			addr.b[5], addr.b[4], addr.b[3], addr.b[2], addr.b[1], addr.b[0], port);
+		return directory_ + name;
+	}
+
+	static bool unix_address(std::string const& path, sockaddr_un& addr)
+	{
+		addr = {};
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) {
+			return false;
+		}
+		std::copy(path.begin(), path.end(), addr.sun_path);
+		return true;
+	}
+
+	int unix_transport::connect(int fd, bdaddr_t addr, uint16_t port) const
+	{
+		sockaddr_un peer;
+		if (!unix_address(path(addr, port), peer)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		return c_connect(fd, (const struct sockaddr*) &peer, sizeof(peer));
+	}
+
+	// the socket file of an earlier run is replaced: only one process can listen on a port
+	int unix_transport::bind(int fd, bdaddr_t addr, uint16_t port) const
+	{
+		sockaddr_un local;
+		auto file {path(addr == ANY ? self() : addr, port)};
+		if (!unix_address(file, local)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		unlink(file.c_str());
+		return c_bind(fd, (const struct sockaddr*) &local, sizeof(local));
+	}
+
+	bool unix_transport::l2cap() const
+	{
+		return false;
+	}
+
+	bdaddr_t unix_transport::self() const
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		return self_;
+	}
+
+	void unix_transport::self(bdaddr_t addr)
+	{
+		std::unique_lock<std::mutex> lock {m_};
+		self_ = addr;
+	}
+
+	void unix_transport::discover(size_t max, std::vector<bdaddr_t>& devices) const
+	{
+		devices.clear();
+		auto local {self()};
+
+		DIR* dir {opendir(directory_.c_str())};
+		if (!dir) {
+			return;
+		}
+
+		for (dirent* entry; devices.size() < max && (entry = readdir(dir));) {
+			unsigned b[6], port;
+			if (sscanf(entry->d_name, "%2X%2X%2X%2X%2X%2X.%4X", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0], &port) != 7) {
+				continue;
+			}
+
+			bdaddr_t addr {};
+			for (size_t i {0}; i < 6; ++i) {
+				addr.b[i] = static_cast<uint8_t>(b[i]);
+			}
+			auto known {std::find_if(devices.begin(), devices.end(), [&addr](bdaddr_t const& other) {
+				return other == addr;
+			})};
+			if (addr != local && known == devices.end()) {
+				devices.push_back(addr);
+			}
+		}
+		closedir(dir);
+	}
+
+} // namespace bluegrass
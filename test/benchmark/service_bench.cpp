@@ -0,0 +1,342 @@
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bluegrass/service.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+using bench_clock = chrono::steady_clock;
+
+/*
+ * "service_bench" measures the throughput and the handoff latency (enqueue to
+ * routine or dequeue) of ENQUEUE, DEQUEUE and NOQUEUE services across thread
+ * counts, element sizes and queue backends. Each configuration runs twice:
+ * a saturated run for throughput, and a closed loop run for latency in which
+ * producers keep at most one element each in flight, so the latency is the
+ * handoff itself rather than the time spent behind a full queue. Results are
+ * printed as CSV, or as JSON with "--json". Options:
+ *	--count N	elements moved per throughput run (default 200000)
+ *	--paced N	elements moved per latency run (default 20000)
+ *	--threads L	comma separated producer and consumer counts (default 1,2,4)
+ *	--json		JSON output instead of CSV
+ */
+
+// element of "BYTES" bytes carrying the time it was handed to the service
+template <size_t BYTES>
+struct element_t {
+	bench_clock::time_point stamp {};
+	array<byte, BYTES - sizeof(bench_clock::time_point)> pad {};
+};
+
+struct result_t {
+	string mode, backend, run;
+	size_t producers, consumers, bytes, count;
+	double seconds;
+	int64_t p50, p99;
+};
+
+/*
+ * "recorder" counts the elements of a run. A paced recorder also keeps the
+ * handoff latency of every element and admits at most "window" elements in
+ * flight: producers call "admit" before stamping an element, and recording it
+ * frees its slot. The completion counter doubles as the sample index, so a
+ * saturated run pays one shared atomic per element.
+ */
+class recorder {
+public:
+	recorder(size_t count, size_t window) : 
+		count_ {count}, samples_(window ? count : 0), free_ {window} {}
+
+	void admit()
+	{
+		if (samples_.empty()) {
+			return;
+		}
+		size_t free {free_.load()};
+		while (!free || !free_.compare_exchange_weak(free, free - 1)) {
+			this_thread::yield();
+			free = free_.load();
+		}
+	}
+
+	void record(bench_clock::time_point stamp)
+	{
+		size_t index {done_.fetch_add(1, memory_order_relaxed)};
+		if (index < samples_.size()) {
+			samples_[index] = chrono::duration_cast<chrono::nanoseconds>(bench_clock::now() - stamp).count();
+			free_.fetch_add(1);
+		}
+	}
+
+	size_t done() const
+	{
+		return done_.load(memory_order_relaxed);
+	}
+
+	void wait() const
+	{
+		while (done() < count_) {
+			this_thread::yield();
+		}
+	}
+
+	// latency percentile of a paced run, -1 for a saturated one
+	int64_t percentile(double p)
+	{
+		if (samples_.empty()) {
+			return -1;
+		}
+		auto nth {samples_.begin() + static_cast<ptrdiff_t>(p * (samples_.size() - 1))};
+		nth_element(samples_.begin(), nth, samples_.end());
+		return *nth;
+	}
+
+private:
+	size_t count_;
+	vector<int64_t> samples_;
+	atomic<size_t> done_ {0};
+	atomic<size_t> free_;
+};
+
+// producers of DEQUEUE and NOQUEUE services take elements from a shared budget
+class budget {
+public:
+	explicit budget(size_t count) : left_ {count} {}
+
+	// blocks the producer once the budget is spent until the run stops
+	bool take()
+	{
+		while (running_) {
+			size_t left {left_.load()};
+			while (left && !left_.compare_exchange_weak(left, left - 1));
+			if (left) {
+				return true;
+			}
+			this_thread::yield();
+		}
+		return false;
+	}
+
+	void stop()
+	{
+		running_ = false;
+	}
+
+private:
+	atomic<size_t> left_;
+	atomic<bool> running_ {true};
+};
+
+// level backends get elements on every level: each producer enqueues on its own
+template <class E, class B>
+void hand(service<E, ENQUEUE, B>& svc, E& e, size_t producer)
+{
+	if constexpr (has_levels<B>::value) {
+		svc.enqueue(e, producer % B::LEVELS);
+	} else {
+		svc.enqueue(e);
+	}
+}
+
+template <class E, class B>
+result_t run_enqueue(size_t producers, size_t consumers, size_t count, bool paced)
+{
+	recorder rec {count, paced ? producers : 0};
+	auto start {bench_clock::now()};
+	{
+		service<E, ENQUEUE, B> svc([&rec](E& e) { rec.record(e.stamp); }, consumers);
+
+		vector<thread> threads {};
+		for (size_t p {0}; p < producers; ++p) {
+			threads.emplace_back([&svc, &rec, p, share = count / producers + (p < count % producers)] {
+				for (size_t i {0}; i < share; ++i) {
+					E e {};
+					rec.admit();
+					e.stamp = bench_clock::now();
+					hand(svc, e, p);
+				}
+			});
+		}
+
+		for (auto& t : threads) {
+			t.join();
+		}
+		rec.wait();
+	}
+	chrono::duration<double> elapsed {bench_clock::now() - start};
+
+	return {"ENQUEUE", "", paced ? "latency" : "throughput", producers, consumers, sizeof(E), count, elapsed.count(), rec.percentile(0.5), rec.percentile(0.99)};
+}
+
+template <class E, class B>
+result_t run_dequeue(size_t producers, size_t consumers, size_t count, bool paced)
+{
+	recorder rec {count, paced ? producers : 0};
+	budget left {count};
+	auto start {bench_clock::now()};
+	{
+		service<E, DEQUEUE, B> svc([&left, &rec](E& e) {
+			if (left.take()) {
+				rec.admit();
+				e.stamp = bench_clock::now();
+			}
+		}, producers);
+
+		vector<thread> threads {};
+		for (size_t c {0}; c < consumers; ++c) {
+			threads.emplace_back([&svc, &rec] {
+				E e {};
+				while (svc.dequeue(e)) {
+					// elements of a stopped producer carry no stamp
+					if (e.stamp != bench_clock::time_point {}) {
+						rec.record(e.stamp);
+					}
+				}
+			});
+		}
+
+		rec.wait();
+		left.stop();
+		svc.shutdown();
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+	chrono::duration<double> elapsed {bench_clock::now() - start};
+
+	return {"DEQUEUE", "", paced ? "latency" : "throughput", producers, consumers, sizeof(E), count, elapsed.count(), rec.percentile(0.5), rec.percentile(0.99)};
+}
+
+template <class E, class B>
+result_t run_noqueue(size_t producers, size_t consumers, size_t count, bool paced)
+{
+	recorder rec {count, paced ? producers : 0};
+	budget left {count};
+	auto start {bench_clock::now()};
+	{
+		service<E, NOQUEUE, B> svc(
+			[&left, &rec](E& e) {
+				if (left.take()) {
+					rec.admit();
+					e.stamp = bench_clock::now();
+				}
+			},
+			[&rec](E& e) {
+				if (e.stamp != bench_clock::time_point {}) {
+					rec.record(e.stamp);
+				}
+			}, producers, consumers);
+
+		rec.wait();
+		left.stop();
+	}
+	chrono::duration<double> elapsed {bench_clock::now() - start};
+
+	return {"NOQUEUE", "", paced ? "latency" : "throughput", producers, consumers, sizeof(E), count, elapsed.count(), rec.percentile(0.5), rec.percentile(0.99)};
+}
+
+template <class E, class B>
+void sweep_backend(string const& name, vector<size_t> const& threads, size_t count, size_t paced, vector<result_t>& results)
+{
+	for (auto producers : threads) {
+		for (auto consumers : threads) {
+			for (auto run : {run_enqueue<E, B>, run_dequeue<E, B>, run_noqueue<E, B>}) {
+				results.push_back(run(producers, consumers, count, false));
+				results.back().backend = name;
+				results.push_back(run(producers, consumers, paced, true));
+				results.back().backend = name;
+			}
+		}
+	}
+}
+
+template <size_t BYTES>
+void sweep(vector<size_t> const& threads, size_t count, size_t paced, vector<result_t>& results)
+{
+	using E = element_t<BYTES>;
+	sweep_backend<E, locked_queue<E>>("locked", threads, count, paced, results);
+	sweep_backend<E, ring_queue<E, 1024>>("ring", threads, count, paced, results);
+	sweep_backend<E, steal_queue<E>>("steal", threads, count, paced, results);
+	sweep_backend<E, level_queue<E, 2>>("level", threads, count, paced, results);
+}
+
+// percentiles are only measured by latency runs
+string percentile(int64_t ns, char const* missing)
+{
+	return ns < 0 ? missing : to_string(ns);
+}
+
+void print_csv(vector<result_t> const& results)
+{
+	cout << "mode,backend,run,producers,consumers,bytes,count,seconds,throughput,p50_ns,p99_ns\n";
+	for (auto const& r : results) {
+		cout << r.mode << ',' << r.backend << ',' << r.run << ',' << r.producers << ',' << r.consumers << ','
+			<< r.bytes << ',' << r.count << ',' << r.seconds << ',' << r.count / r.seconds << ','
+			<< percentile(r.p50, "") << ',' << percentile(r.p99, "") << '\n';
+	}
+}
+
+void print_json(vector<result_t> const& results)
+{
+	cout << "[\n";
+	for (size_t i {0}; i < results.size(); ++i) {
+		auto const& r {results[i]};
+		cout << "  {\"mode\": \"" << r.mode << "\", \"backend\": \"" << r.backend
+			<< "\", \"run\": \"" << r.run << "\", \"producers\": " << r.producers << ", \"consumers\": " << r.consumers
+			<< ", \"bytes\": " << r.bytes << ", \"count\": " << r.count
+			<< ", \"seconds\": " << r.seconds << ", \"throughput\": " << r.count / r.seconds
+			<< ", \"p50_ns\": " << percentile(r.p50, "null") << ", \"p99_ns\": " << percentile(r.p99, "null") << '}'
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	cout << "]\n";
+}
+
+int main(int argc, char** argv)
+{
+	size_t count {200000}, paced {20000};
+	vector<size_t> threads {1, 2, 4};
+	bool json {false};
+
+	for (int i {1}; i < argc; ++i) {
+		if (!strcmp(argv[i], "--json")) {
+			json = true;
+		} else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+			count = stoul(argv[++i]);
+		} else if (!strcmp(argv[i], "--paced") && i + 1 < argc) {
+			paced = stoul(argv[++i]);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threads.clear();
+			string list {argv[++i]};
+			for (size_t pos {0}; pos < list.size();) {
+				size_t end {min(list.find(',', pos), list.size())};
+				threads.push_back(max<size_t>(stoul(list.substr(pos, end - pos)), 1));
+				pos = end + 1;
+			}
+		} else {
+			cerr << "usage: " << argv[0] << " [--count N] [--paced N] [--threads 1,2,4] [--json]\n";
+			return 1;
+		}
+	}
+
+	vector<result_t> results {};
+	sweep<16>(threads, count, paced, results);
+	sweep<64>(threads, count, paced, results);
+	sweep<256>(threads, count, paced, results);
+
+	if (json) {
+		print_json(results);
+	} else {
+		print_csv(results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __BLUEGRASS_TEST_LOOPBACK__
+#define __BLUEGRASS_TEST_LOOPBACK__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bluegrass/socket.hpp"
+#include "bluegrass/transport.hpp"
+
+/*
+ * Preamble shared by the tests which run connections: sockets run over socket
+ * files instead of a radio. A test passes "LOOPBACK" to "transport::use" first
+ * and picks a port of its own, so tests running side by side never meet.
+ */
+
+inline bdaddr_t const DEVICE {0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+inline bluegrass::unix_transport LOOPBACK {DEVICE, "/tmp/bluegrass_test"};
+
+/*
+ * "loopback_t" is a server on "port" of the loopback device, running "ROUTINE"
+ * for every connection, and a client connected to it. The client closes first,
+ * so routines serving it until it hangs up end before the service joins them.
+ */
+template <auto ROUTINE, size_t THREADS = 1>
+struct loopback_t {
+	explicit loopback_t(uint16_t port) :
+		server {bluegrass::ANY, port, svc, bluegrass::async_t::SERVER},
+		client {bluegrass::socket {DEVICE, port}}
+	{}
+
+	bluegrass::async_socket::service_handle svc {ROUTINE, THREADS};
+	bluegrass::async_socket server;
+	bluegrass::scoped_socket client;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bluegrass/buffer_pool.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+size_t const THREADS {4};
+size_t const ROUNDS {10000};
+
+// routine checks the size classes and that a returned buffer is handed out again
+bool test_classes()
+{
+	auto& pool {buffer_pool::access()};
+	bool result {true};
+
+	for (size_t size : {1, 64, 65, 255, 1000, 4096, 65536}) {
+		auto buffer {pool.acquire(size)};
+		result = result && buffer && buffer.size() == size && buffer.capacity() >= size;
+		result = result && buffer.capacity() < size * 2 + buffer_pool::MIN;
+	}
+
+	// the last buffer returned on a thread is the first one handed out again
+	auto first {pool.acquire(100)};
+	auto data {first.data()};
+	first.release();
+	auto second {pool.acquire(120)};
+	result = result && !first && second.data() == data && second.capacity() == 128;
+
+	// above "MAX" buffers are allocated on their own
+	auto large {pool.acquire(buffer_pool::MAX + 1)};
+	memset(large.data(), 0xff, large.size());
+	result = result && large.capacity() == buffer_pool::MAX + 1;
+
+	return result;
+}
+
+// routine checks out buffers on many threads and releases them on others
+bool test_threads()
+{
+	atomic<bool> result {true};
+	vector<buffer_t> handed(THREADS * ROUNDS);
+
+	vector<thread> threads {};
+	for (size_t t {0}; t < THREADS; ++t) {
+		threads.emplace_back([&handed, &result, t] {
+			auto& pool {buffer_pool::access()};
+			for (size_t i {0}; i < ROUNDS; ++i) {
+				auto buffer {pool.acquire(16 + (i * 37) % 2000)};
+				memset(buffer.data(), static_cast<int>(t), buffer.size());
+				handed[t * ROUNDS + i] = std::move(buffer);
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	// no buffer was handed out twice: every one still holds its writer's pattern
+	for (size_t t {0}; t < THREADS; ++t) {
+		for (size_t i {0}; i < ROUNDS; ++i) {
+			auto span {handed[t * ROUNDS + i].span()};
+			for (auto b : span) {
+				if (b != static_cast<byte>(t)) {
+					result = false;
+				}
+			}
+		}
+	}
+
+	// releases on threads which did not acquire the buffers
+	threads.clear();
+	for (size_t t {0}; t < THREADS; ++t) {
+		threads.emplace_back([&handed, t] {
+			for (size_t i {0}; i < ROUNDS; ++i) {
+				handed[((t + 1) % THREADS) * ROUNDS + i].release();
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	cout << "buffer pool threads passed " << result << endl;
+	return result;
+}
+
+int main()
+{
+	bool result = test_classes();
+	assert(result);
+	result = test_threads();
+	assert(result);
+
+	return 0;
+}
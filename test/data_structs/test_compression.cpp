@@ -0,0 +1,146 @@
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bluegrass/compression.hpp"
+#include "loopback.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+uint16_t const PORT {0x1004};
+uint16_t const LATE_PORT {0x1006};
+
+// telemetry like log lines: repetitive, as most of the traffic on a link
+vector<byte> text(size_t lines)
+{
+	string log {};
+	for (size_t i {0}; i < lines; ++i) {
+		log += "sensor " + to_string(i % 7) + " reading " + to_string(i * 13 % 100) + " status nominal\n";
+	}
+	auto bytes {as_bytes(span {log})};
+	return {bytes.begin(), bytes.end()};
+}
+
+vector<byte> noise(size_t size)
+{
+	mt19937 generator {42};
+	vector<byte> bytes(size);
+	for (auto& b : bytes) {
+		b = static_cast<byte>(generator());
+	}
+	return bytes;
+}
+
+bool round_trip(vector<byte> const& in, size_t& packed)
+{
+	vector<byte> out(lz_bound(in.size())), back(in.size());
+	packed = lz_compress(in, out);
+	if (!packed && !in.empty()) {
+		return false;
+	}
+	ssize_t n {lz_decompress(span {out.data(), packed}, back)};
+	return n == static_cast<ssize_t>(in.size()) && back == in;
+}
+
+// routine compresses and restores repetitive, long runs, incompressible and tiny inputs
+bool test_codec()
+{
+	size_t packed;
+	auto log {text(200)};
+	bool result {round_trip(log, packed) && packed < log.size() / 3};
+	cout << "log of " << log.size() << " bytes packed to " << packed << endl;
+
+	result = result && round_trip(vector<byte>(5000, byte {7}), packed) && packed < 50;
+	result = result && round_trip(noise(3000), packed);
+	result = result && round_trip({}, packed) && round_trip(vector<byte>(3, byte {1}), packed);
+
+	// output which would not fit is refused, malformed input is rejected
+	auto random {noise(500)};
+	vector<byte> small(random.size() - 1), back(100);
+	result = result && !lz_compress(random, small);
+	vector<byte> corrupt {byte {0x1F}, byte {'a'}, byte {9}, byte {0}};
+	result = result && lz_decompress(corrupt, back) == -1;
+	result = result && lz_decompress(vector<byte>(1, byte {0xF0}), back) == -1;
+
+	return result;
+}
+
+// answers every payload with the same payload
+void echo(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	compressor codec {us};
+	while (auto payload {codec.receive()}) {
+		codec.send(payload.span());
+	}
+}
+
+// routine negotiates compression across a loopback connection and echoes through it
+bool test_loopback()
+{
+	loopback_t<echo> link {PORT};
+	compressor codec {link.client};
+	bool result {codec.negotiated() && codec.compressing()};
+
+	// below the threshold payloads go out as they are
+	auto log {text(100)}, line {text(1)};
+	for (auto const& payload : {log, line}) {
+		result = result && codec.send(payload);
+		auto answer {codec.receive()};
+		result = result && answer && equal(answer.span().begin(), answer.span().end(), payload.begin(), payload.end());
+	}
+
+	cout << "compression saved " << codec.saved() << " of " << log.size() + line.size() << " bytes" << endl;
+	return result && codec.saved() > log.size() / 2 && codec.saved() < log.size();
+}
+
+atomic<int> late_negotiated {-1};
+
+// answers payloads like "echo", but constructs its compressor after the peer gave up
+void late_echo(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	this_thread::sleep_for(chrono::milliseconds {100});
+	compressor codec {us, {true, 64, chrono::milliseconds {100}}};
+	late_negotiated = codec.negotiated();
+	while (auto payload {codec.receive()}) {
+		codec.send(payload.span());
+	}
+}
+
+// routine checks both ends stay plain when one negotiates too late for the other
+bool test_late_peer()
+{
+	loopback_t<late_echo> link {LATE_PORT};
+	compressor codec {link.client, {true, 64, chrono::milliseconds {20}}};
+	bool result {!codec.negotiated()};
+
+	// the late HELLO and ACK are reported as errors, never handed out as payloads
+	auto log {text(10)};
+	result = result && codec.send(log) && !codec.receive() && !codec.receive();
+	auto answer {codec.receive()};
+	result = result && answer && equal(answer.span().begin(), answer.span().end(), log.begin(), log.end());
+
+	return result && late_negotiated == 0;
+}
+
+int main()
+{
+	transport::use(LOOPBACK);
+
+	bool result = test_codec();
+	assert(result);
+	result = test_loopback();
+	assert(result);
+	result = test_late_peer();
+	assert(result);
+
+	return 0;
+}
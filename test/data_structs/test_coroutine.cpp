@@ -0,0 +1,210 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "bluegrass/executor.hpp"
+#include "bluegrass/reactor.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+size_t const LAST {10000};
+size_t const CONVERSATIONS {100};
+
+// outlives every test: a reactor thread may still be posting to it after a coroutine finished
+executor EXEC {2};
+
+// routine suspends many coroutines on one DEQUEUE service, resumed by the executor threads
+bool test_dequeue_await()
+{
+	atomic<size_t> sum {0}, count {0}, done {0};
+	atomic<size_t> next {1};
+
+	// producers emit 1..LAST, then zeros until shutdown: the bounded ring holds them back
+	service<size_t, queue_t::DEQUEUE, ring_queue<size_t, 64>> numbers([&next](size_t& data) {
+		data = next++;
+		if (data > LAST) {
+			data = 0;
+			this_thread::yield();
+		}
+	}, 1);
+
+	for (size_t i {0}; i < CONVERSATIONS; ++i) {
+		EXEC.spawn([](auto& svc, auto& sum, auto& count, auto& done) -> task {
+			while (auto data {co_await svc.dequeue()}) {
+				if (*data) {
+					sum += *data;
+					++count;
+				}
+			}
+			++done;
+		}(numbers, sum, count, done));
+	}
+
+	while (count < LAST) {
+		this_thread::yield();
+	}
+	numbers.shutdown();
+
+	while (done < CONVERSATIONS) {
+		this_thread::yield();
+	}
+
+	cout << "dequeue await sum " << sum << endl;
+	return sum == LAST * (LAST + 1) / 2;
+}
+
+// routine parks a coroutine on the reactor until datagrams arrive on a socket pair
+bool test_socket_await()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+		return false;
+	}
+
+	atomic<size_t> received {0};
+	atomic<bool> ordered {true}, done {false};
+	EXEC.spawn([](int fd, auto& received, auto& ordered, auto& done) -> task {
+		for (size_t expect {0}; expect < 100; ++expect) {
+			size_t data {};
+			ssize_t n {co_await io_awaiter {fd, EPOLLIN, [fd, &data] {
+				return recv(fd, &data, sizeof(data), MSG_DONTWAIT);
+			}}};
+			if (n != sizeof(data) || data != expect) {
+				ordered = false;
+			}
+			++received;
+		}
+		done = true;
+	}(fds[0], received, ordered, done));
+
+	// gives the coroutine time to park before every datagram
+	for (size_t i {0}; i < 100; ++i) {
+		this_thread::sleep_for(chrono::microseconds {100});
+		send(fds[1], &i, sizeof(i), 0);
+	}
+
+	while (!done) {
+		this_thread::yield();
+	}
+
+	reactor::access().forget(fds[0]);
+	close(fds[0]);
+	close(fds[1]);
+
+	cout << "socket await received " << received << endl;
+	return received == 100 && ordered;
+}
+
+// binding which drains its socket and counts the reactor calls
+struct counter_t : reactor::binding_t {
+	counter_t()
+	{
+		flush = [] { ++flushes; };
+	}
+
+	void ready(int fd) override
+	{
+		size_t data {};
+		while (recv(fd, &data, sizeof(data), MSG_DONTWAIT) == sizeof(data)) {
+			++received;
+		}
+	}
+
+	inline static atomic<size_t> received {0}, flushes {0};
+};
+
+// routine binds a socket pair to the reactor: every datagram is collected and flushed
+bool test_reactor_bind()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+		return false;
+	}
+
+	counter_t counter {};
+	reactor::access().bind(fds[0], counter);
+
+	for (size_t i {0}; i < 100; ++i) {
+		send(fds[1], &i, sizeof(i), 0);
+		if (i % 10 == 0) {
+			this_thread::sleep_for(chrono::microseconds {100});
+		}
+	}
+
+	auto deadline {chrono::steady_clock::now() + chrono::seconds {5}};
+	while (counter_t::received < 100 && chrono::steady_clock::now() < deadline) {
+		this_thread::yield();
+	}
+
+	reactor::access().forget(fds[0]);
+	close(fds[0]);
+	close(fds[1]);
+
+	cout << "reactor bind received " << counter_t::received << " in " << counter_t::flushes << " flushes" << endl;
+	return counter_t::received == 100 && counter_t::flushes > 0;
+}
+
+// binding whose flush is slow, as one enqueueing into a busy service
+struct slow_t : reactor::binding_t {
+	slow_t()
+	{
+		flush = [] {
+			started = true;
+			this_thread::sleep_for(chrono::milliseconds {100});
+			finished = true;
+		};
+	}
+
+	void ready(int fd) override
+	{
+		size_t data {};
+		while (recv(fd, &data, sizeof(data), MSG_DONTWAIT) == sizeof(data));
+	}
+
+	inline static atomic<bool> started {false}, finished {false};
+};
+
+// routine forgets a socket while its work is being flushed: "forget" returns after the flush
+bool test_reactor_forget()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+		return false;
+	}
+
+	slow_t slow {};
+	reactor::access().bind(fds[0], slow);
+	size_t data {1};
+	send(fds[1], &data, sizeof(data), 0);
+
+	auto deadline {chrono::steady_clock::now() + chrono::seconds {5}};
+	while (!slow_t::started && chrono::steady_clock::now() < deadline) {
+		this_thread::yield();
+	}
+
+	reactor::access().forget(fds[0]);
+	bool result {slow_t::started && slow_t::finished};
+	close(fds[0]);
+	close(fds[1]);
+	return result;
+}
+
+int main()
+{
+	bool result = test_dequeue_await();
+	assert(result);
+	result = test_socket_await();
+	assert(result);
+	result = test_reactor_bind();
+	assert(result);
+	result = test_reactor_forget();
+	assert(result);
+
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bluegrass/flat.hpp"
+#include "loopback.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+uint16_t const PORT {0x1005};
+
+struct telemetry_t {
+	uint8_t sensor;
+	string name;
+	vector<uint32_t> samples;
+	double scale;
+	string note;
+};
+
+template <>
+struct bluegrass::described<telemetry_t> : fields<&telemetry_t::sensor, &telemetry_t::name, &telemetry_t::samples, &telemetry_t::scale, &telemetry_t::note> {};
+
+// the fixed capacity message this format replaces
+struct legacy_t {
+	uint8_t sensor;
+	char name[32];
+	uint32_t samples[16];
+	double scale;
+	char note[64];
+};
+
+telemetry_t const SAMPLE {3, "thermistor", {20, 21, 23}, 0.5, ""};
+
+bool same(telemetry_t const& a, telemetry_t const& b)
+{
+	return a.sensor == b.sensor && a.name == b.name && a.samples == b.samples && a.scale == b.scale && a.note == b.note;
+}
+
+// routine writes a message and reads every member back in place
+bool test_round_trip()
+{
+	size_t size {flat_size(SAMPLE)};
+	auto buffer {buffer_pool::access().acquire(size)};
+	bool result {flat_write(SAMPLE, buffer.span()) == size && size < sizeof(legacy_t)};
+	cout << "flat message of " << size << " bytes instead of " << sizeof(legacy_t) << endl;
+
+	auto start {buffer.data()}, end {buffer.data() + buffer.size()};
+	flat_view<telemetry_t> view {std::move(buffer)};
+	auto name {view.get<&telemetry_t::name>()};
+	auto samples {view.get<&telemetry_t::samples>()};
+
+	// variable members point into the datagram, nothing was copied
+	result = result && view && name == "thermistor" && view.get<&telemetry_t::sensor>() == 3;
+	result = result && samples.size() == 3 && samples[2] == 23 && view.get<&telemetry_t::scale>() == 0.5;
+	result = result && reinterpret_cast<const byte*>(name.data()) >= start && reinterpret_cast<const byte*>(samples.data()) < end;
+	result = result && view.get<&telemetry_t::note>().empty() && same(view.copy(), SAMPLE);
+
+	return result;
+}
+
+// routine rejects datagrams which cannot hold what they claim and messages which do not fit
+bool test_malformed()
+{
+	auto buffer {buffer_pool::access().acquire(flat_size(SAMPLE))};
+	flat_write(SAMPLE, buffer.span());
+
+	bool result {!flat_view<telemetry_t> {buffer.span().first(buffer.size() - 1)}};
+	result = result && !flat_view<telemetry_t> {buffer.span().first(4)} && !flat_view<telemetry_t> {};
+
+	// a misaligned datagram would hand out misaligned arrays
+	vector<byte> shifted(buffer.size() + 1);
+	copy(buffer.span().begin(), buffer.span().end(), shifted.begin() + 1);
+	result = result && !flat_view<telemetry_t> {span {shifted}.subspan(1)};
+
+	telemetry_t huge {SAMPLE};
+	huge.note.assign(UINT16_MAX + 1, 'x');
+	vector<byte> out(flat_size(huge));
+	result = result && !flat_write(huge, out) && !flat_write(SAMPLE, buffer.span().first(8));
+
+	return result;
+}
+
+// answers every message with its samples doubled
+void twice(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	while (auto message {us.receive<telemetry_t>()}) {
+		auto answer {message.copy()};
+		for (auto& sample : answer.samples) {
+			sample *= 2;
+		}
+		us.send(answer);
+	}
+}
+
+// routine sends described messages across a loopback connection
+bool test_loopback()
+{
+	loopback_t<twice> link {PORT};
+
+	bool result {link.client.send(SAMPLE)};
+	auto answer {link.client.receive<telemetry_t>()};
+	auto samples {answer.get<&telemetry_t::samples>()};
+	result = result && answer && answer.get<&telemetry_t::name>() == SAMPLE.name;
+	result = result && samples.size() == 3 && samples[0] == 40 && samples[2] == 46;
+
+	cout << "loopback answered " << answer.bytes().size() << " bytes" << endl;
+	return result;
+}
+
+int main()
+{
+	transport::use(LOOPBACK);
+
+	bool result = test_round_trip();
+	assert(result);
+	result = test_malformed();
+	assert(result);
+	result = test_loopback();
+	assert(result);
+
+	return 0;
+}
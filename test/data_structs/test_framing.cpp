@@ -0,0 +1,104 @@
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bluegrass/framing.hpp"
+#include "loopback.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+uint16_t const PORT {0x1002};
+size_t const SNAPSHOT {10000};
+
+// builds the datagram of one fragment of "message"
+vector<byte> fragment(uint16_t id, vector<byte> const& message, size_t offset, size_t length)
+{
+	fragment_t header {static_cast<uint32_t>(message.size()), static_cast<uint32_t>(offset), id, 0};
+	vector<byte> datagram(sizeof(header) + length);
+	memcpy(datagram.data(), &header, sizeof(header));
+	memcpy(datagram.data() + sizeof(header), message.data() + offset, length);
+	return datagram;
+}
+
+vector<byte> pattern(size_t size, size_t seed)
+{
+	vector<byte> message(size);
+	for (size_t i {0}; i < size; ++i) {
+		message[i] = static_cast<byte>(i * 31 + seed);
+	}
+	return message;
+}
+
+// routine reassembles interleaved messages and drops the ones which cannot complete
+bool test_reassembly()
+{
+	bluegrass::socket none {};
+	framer frames {none, {0, 4096, 2, chrono::milliseconds {50}}};
+
+	auto first {pattern(300, 1)}, second {pattern(200, 2)};
+	bool result {!frames.feed(fragment(1, first, 0, 100))};
+	result = result && !frames.feed(fragment(2, second, 0, 150));
+	result = result && !frames.feed(fragment(1, first, 100, 100));
+
+	auto done {frames.feed(fragment(2, second, 150, 50))};
+	result = result && done && equal(done.span().begin(), done.span().end(), second.begin(), second.end());
+	done = frames.feed(fragment(1, first, 200, 100));
+	result = result && done && equal(done.span().begin(), done.span().end(), first.begin(), first.end());
+
+	// a third pending message pushes out the oldest one
+	result = result && !frames.feed(fragment(3, first, 0, 10)) && !frames.feed(fragment(4, first, 0, 10));
+	result = result && !frames.feed(fragment(5, first, 0, 10)) && frames.dropped() == 1;
+
+	// incomplete messages time out, oversized and malformed fragments are dropped
+	this_thread::sleep_for(chrono::milliseconds {60});
+	result = result && !frames.feed(fragment(6, pattern(5000, 3), 0, 10)) && frames.dropped() == 4;
+	result = result && !frames.feed(vector<byte>(4)) && frames.dropped() == 5;
+
+	// a repeated fragment would leave a gap: its message is dropped, and so are its later fragments
+	result = result && !frames.feed(fragment(7, second, 0, 100)) && !frames.feed(fragment(7, second, 0, 100));
+	result = result && !frames.feed(fragment(7, second, 100, 100)) && frames.dropped() == 7;
+
+	return result;
+}
+
+// answers every message with the same message
+void echo(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	framer frames {us};
+	while (auto message {frames.receive()}) {
+		frames.send(message.span());
+	}
+}
+
+// routine ships a snapshot many times the MTU across a loopback connection
+bool test_loopback()
+{
+	loopback_t<echo> link {PORT};
+	framer frames {link.client};
+
+	auto snapshot {pattern(SNAPSHOT, 4)};
+	bool result {frames.send(snapshot)};
+	auto answer {frames.receive()};
+	result = result && answer && equal(answer.span().begin(), answer.span().end(), snapshot.begin(), snapshot.end());
+
+	cout << "framed snapshot of " << answer.size() << " bytes" << endl;
+	return result;
+}
+
+int main()
+{
+	transport::use(LOOPBACK);
+
+	bool result = test_reassembly();
+	assert(result);
+	result = test_loopback();
+	assert(result);
+
+	return 0;
+}
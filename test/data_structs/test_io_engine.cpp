@@ -0,0 +1,149 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "bluegrass/io_engine.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+size_t const PAIRS {8};
+
+// routine moves one datagram over every socket pair with one send and one receive batch
+bool test_batch()
+{
+	vector<int> fds(PAIRS * 2);
+	for (size_t i {0}; i < PAIRS; ++i) {
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, &fds[i * 2]) == -1) {
+			return false;
+		}
+	}
+
+	vector<size_t> out(PAIRS), in(PAIRS);
+	vector<io_op_t> sends(PAIRS), receives(PAIRS);
+	for (size_t i {0}; i < PAIRS; ++i) {
+		out[i] = i * 7 + 1;
+		sends[i] = {fds[i * 2 + 1], &out[i], sizeof(size_t), 0};
+		receives[i] = {fds[i * 2], &in[i], sizeof(size_t), 0};
+	}
+
+	auto& engine {io_engine::local()};
+	bool result {engine.send(sends.data(), PAIRS) == PAIRS && engine.receive(receives.data(), PAIRS) == PAIRS};
+	for (size_t i {0}; i < PAIRS; ++i) {
+		result = result && in[i] == out[i] && receives[i].result == sizeof(size_t);
+	}
+
+	// nothing is left to receive: a non-blocking receive reports EAGAIN per operation
+	receives[0].flags = MSG_DONTWAIT;
+	result = result && engine.receive(receives.data(), 1) == 0 && receives[0].result == -EAGAIN;
+
+	for (int fd : fds) {
+		close(fd);
+	}
+
+	cout << "batch over " << (engine.uring() ? "io_uring" : "syscalls") << endl;
+	return result;
+}
+
+// routine sends from and receives into registered buffers
+bool test_registered_buffers()
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+		return false;
+	}
+
+	alignas(64) static char memory[2][256];
+	iovec buffers[2] {{memory[0], sizeof(memory[0])}, {memory[1], sizeof(memory[1])}};
+
+	auto& engine {io_engine::local()};
+	bool result {engine.buffers(buffers, 2)};
+
+	strcpy(memory[0], "registered");
+	io_op_t send {fds[1], memory[0], 11, 0, 0};
+	io_op_t receive {fds[0], memory[1], sizeof(memory[1]), 0, 1};
+	result = result && engine.send(&send, 1) == 1 && engine.receive(&receive, 1) == 1;
+	result = result && receive.result == 11 && !strcmp(memory[1], "registered");
+
+	engine.buffers(nullptr, 0);
+	close(fds[0]);
+	close(fds[1]);
+	return result;
+}
+
+// listener which counts and closes the clients it is handed
+struct counter_t : acceptor::listener_t {
+	void accepted(int client) override
+	{
+		close(client);
+		++clients;
+	}
+
+	atomic<size_t> clients {0};
+};
+
+// routine accepts a burst of connections with one multishot accept
+bool test_acceptor()
+{
+	auto& accept {acceptor::access()};
+	if (!accept.available()) {
+		cout << "acceptor unavailable, servers bind to the reactor" << endl;
+		counter_t unused {};
+		return !accept.listen(-1, unused);
+	}
+
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path + 1, "bluegrass_acceptor_test");
+	auto len {static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + strlen(addr.sun_path + 1))};
+
+	int server {::socket(AF_UNIX, SOCK_SEQPACKET, 0)};
+	if (server == -1 || bind(server, (sockaddr*) &addr, len) == -1 || listen(server, 16) == -1) {
+		return false;
+	}
+
+	counter_t counter {};
+	bool result {accept.listen(server, counter)};
+
+	vector<int> clients {};
+	for (size_t i {0}; i < 10; ++i) {
+		int client {::socket(AF_UNIX, SOCK_SEQPACKET, 0)};
+		connect(client, (sockaddr*) &addr, len);
+		clients.push_back(client);
+	}
+
+	auto deadline {chrono::steady_clock::now() + chrono::seconds {5}};
+	while (counter.clients < clients.size() && chrono::steady_clock::now() < deadline) {
+		this_thread::yield();
+	}
+
+	accept.forget(server);
+	for (int client : clients) {
+		close(client);
+	}
+	close(server);
+
+	cout << "acceptor accepted " << counter.clients << endl;
+	return result && counter.clients == clients.size();
+}
+
+int main()
+{
+	bool result = test_batch();
+	assert(result);
+	result = test_registered_buffers();
+	assert(result);
+	result = test_acceptor();
+	assert(result);
+
+	return 0;
+}
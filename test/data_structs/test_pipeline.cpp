@@ -0,0 +1,58 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <string>
+
+#include "bluegrass/pipeline.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+size_t const LAST {10000};
+atomic<size_t> NEXT {1};
+
+// creates the series 1..LAST, then zeros once exhausted
+void create(size_t& data) 
+{
+	data = NEXT++;
+	if (data > LAST) {
+		data = 0;
+		this_thread::yield();
+	}
+}
+
+// filters the zeros and renders the rest as strings
+bool render(size_t& in, string& out) 
+{
+	out = to_string(in);
+	return in;
+}
+
+// routine chains a source, two stages, and a sink, each with their own threads
+bool test_pipeline() 
+{
+	atomic<size_t> sum {0}, count {0};
+	size_t expect {LAST * (LAST + 1) / 2};
+
+	auto p {source<size_t>(create, 2) 
+		| stage<size_t, string>(render, 2) 
+		| stage<string, size_t>([](string& in, size_t& out) { out = stoul(in); }, threads_t {1, 4})
+		| sink<size_t>([&](size_t& data) { sum += data; ++count; }, 2)};
+
+	while (sum != expect) {
+		this_thread::yield();
+	}
+	p.shutdown();
+
+	return count == LAST;
+}
+
+int main() 
+{
+	bool result = test_pipeline();
+	assert(result);
+	cout << "pipeline passed\n";
+	
+	return 0;
+}
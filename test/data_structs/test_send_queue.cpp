@@ -0,0 +1,101 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <thread>
+
+#include "bluegrass/send_queue.hpp"
+#include "loopback.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+uint16_t const PORT {0x1003};
+size_t const DATAGRAM {1024};
+
+atomic<bool> reading {false};
+atomic<uint32_t> received {0};
+atomic<bool> ordered {true};
+
+struct datagram_t {
+	uint32_t sequence;
+	byte padding[DATAGRAM - sizeof(uint32_t)];
+};
+
+// reads nothing until released, then checks every datagram arrives in order
+void sink(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	while (!reading) {
+		this_thread::sleep_for(chrono::milliseconds {1});
+	}
+
+	// the span overload reports a closed connection as 0 bytes
+	datagram_t datagram;
+	while (us.receive(as_writable_bytes(span {&datagram, 1})) == sizeof(datagram)) {
+		if (datagram.sequence != received) {
+			ordered = false;
+		}
+		++received;
+	}
+}
+
+// routine fills a connection which is not read until it is congested, then lets it drain
+bool test_backpressure()
+{
+	loopback_t<sink> link {PORT};
+
+	uint32_t sent {0};
+	{
+		send_queue queue {link.client, {16 * DATAGRAM, 4 * DATAGRAM}};
+		datagram_t datagram {};
+
+		bool result {true};
+		sent_t outcome {sent_t::SENT};
+		while (outcome == sent_t::SENT || outcome == sent_t::QUEUED) {
+			datagram.sequence = sent;
+			// gathered from a header and a payload, queued datagrams are copied whole
+			outcome = queue.send(&datagram.sequence, as_bytes(span {datagram.padding}));
+			if (outcome != sent_t::CONGESTED) {
+				++sent;
+			}
+		}
+		result = result && outcome == sent_t::CONGESTED && queue.congested() && queue.queued() >= 16 * DATAGRAM;
+		result = result && !queue.wait(chrono::milliseconds {20});
+
+		reading = true;
+		result = result && queue.wait(chrono::milliseconds {2000}) && queue.queued() <= 4 * DATAGRAM;
+
+		// once relieved the queue takes datagrams again, behind the ones left
+		datagram.sequence = sent;
+		outcome = queue.send(&datagram);
+		result = result && (outcome == sent_t::SENT || outcome == sent_t::QUEUED);
+		++sent;
+
+		for (int i {0}; i < 200 && queue.queued(); ++i) {
+			this_thread::sleep_for(chrono::milliseconds {5});
+		}
+		if (!result || queue.queued()) {
+			return false;
+		}
+	}
+
+	for (int i {0}; i < 200 && received < sent; ++i) {
+		this_thread::sleep_for(chrono::milliseconds {5});
+	}
+
+	cout << "drained " << received << " of " << sent << " datagrams" << endl;
+	return received == sent && ordered;
+}
+
+int main()
+{
+	transport::use(LOOPBACK);
+
+	bool result = test_backpressure();
+	assert(result);
+
+	return 0;
+}
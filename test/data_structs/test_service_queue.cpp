@@ -1,6 +1,10 @@
 #include <iostream>
 #include <cassert>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <string>
 
 #include "bluegrass/service.hpp"
 
@@ -67,6 +71,237 @@ bool test_no_queue()
 	return true;
 }
 
+// pushes a known series through a small lock-free ring so producers block on a full ring
+bool test_ring_queue() 
+{
+	atomic<size_t> sum {0};
+	size_t expect {0};
+	{
+		service<size_t, queue_t::ENQUEUE, ring_queue<size_t, 16>> rq(
+			[&sum](size_t& data) { sum += data; }, 4);
+
+		for (size_t i {1}; i <= 10000; ++i) {
+			expect += i;
+			rq.enqueue(i);
+		}
+		// service destructor drains the ring before joining
+	}
+	
+	return sum == expect;
+}
+
+// moves arrays through a batch service and back out of a DEQUEUE service in bulk
+bool test_bulk_queue() 
+{
+	atomic<size_t> sum {0};
+	size_t expect {0}, data[32];
+	{
+		service<size_t, queue_t::ENQUEUE> bq([&sum](span<size_t> batch) { 
+			for (auto element : batch) {
+				sum += element;
+			}
+		}, 2, 16);
+
+		for (size_t i {0}; i < 100; ++i) {
+			for (size_t j {0}; j < 32; ++j) {
+				data[j] = i * 32 + j;
+				expect += data[j];
+			}
+			bq.enqueue_bulk(data);
+		}
+	}
+
+	// one producer numbers the elements: a bulk dequeue takes them whole and in order
+	size_t next {0};
+	service<size_t, queue_t::DEQUEUE> dq([&next](size_t& data) { data = next++; }, 1);
+	size_t count {0};
+	bool ordered {true};
+	while (count < 100) {
+		size_t n {dq.dequeue_bulk(data)};
+		ordered = ordered && n && n <= 32;
+		for (size_t i {0}; i < n; ++i) {
+			ordered = ordered && data[i] == count + i;
+		}
+		count += n;
+	}
+	dq.shutdown();
+
+	return sum == expect && ordered;
+}
+
+// work stealing NOQUEUE service: consumers steal from the producers' lanes
+bool test_steal_queue() 
+{
+	atomic<size_t> next {1}, sum {0};
+	size_t const last {10000};
+	size_t expect {last * (last + 1) / 2};
+
+	service<size_t, queue_t::NOQUEUE, steal_queue<size_t>> sq(
+		[&next, last](size_t& data) { 
+			data = next++;
+			if (data > last) {
+				data = 0;
+				this_thread::yield();
+			}
+		}, 
+		[&sum](size_t& data) { sum += data; }, 2, 4);
+
+	while (sum != expect) {
+		this_thread::yield();
+	}
+	
+	return true;
+}
+
+// elastic pool grows under backlog, retires idle workers, and resizes on request
+bool test_elastic_pool() 
+{
+	atomic<size_t> sum {0};
+	size_t expect {0}, peak {0};
+	threads_t pool {1, 4};
+	pool.idle = chrono::milliseconds {50};
+
+	service<size_t, queue_t::ENQUEUE> ep([&sum](size_t& data) { 
+		this_thread::sleep_for(chrono::microseconds {200});
+		sum += data; 
+	}, pool);
+
+	for (size_t i {1}; i <= 500; ++i) {
+		expect += i;
+		ep.enqueue(i);
+		peak = max(peak, ep.workers());
+	}
+	while (sum != expect) {
+		peak = max(peak, ep.workers());
+		this_thread::yield();
+	}
+
+	this_thread::sleep_for(chrono::milliseconds {300});
+	bool shrunk {ep.workers() == 1};
+
+	ep.resize(3);
+	bool grown {ep.workers() == 3};
+	ep.resize(1);
+	this_thread::sleep_for(chrono::milliseconds {50});
+	
+	return peak > 1 && shrunk && grown && ep.workers() == 1;
+}
+
+// queues two levels behind a blocked worker, then checks the order they drain in
+template <size_t BURST>
+string drain_levels() 
+{
+	atomic<bool> gate {false};
+	string order;
+	{
+		service<char, queue_t::ENQUEUE, level_queue<char, 2, BURST>> lq([&](char& data) { 
+			while (!gate) {
+				this_thread::yield();
+			}
+			order += data;
+		}, 1);
+
+		char data {'G'};
+		lq.enqueue(data, 1);
+		this_thread::sleep_for(chrono::milliseconds {20});
+
+		for (size_t i {0}; i < 4; ++i) {
+			data = 'L';
+			lq.enqueue(data);
+			data = 'H';
+			lq.enqueue(data, 0);
+		}
+		gate = true;
+	}
+
+	return order;
+}
+
+// strict priority drains the high level first, a burst of 2 lets the low level through
+bool test_level_queue() 
+{
+	return drain_levels<0>() == "GHHHHLLLL" && drain_levels<2>() == "GHHLHHLLL";
+}
+
+// pins a named worker to core 0 and checks the settings from inside the routine
+bool test_thread_config() 
+{
+	atomic<bool> placed {false};
+	threads_t threads {1};
+	threads.cpus = {0};
+	threads.spread = true;
+	threads.name = "svc";
+	{
+		service<char, queue_t::ENQUEUE> tc([&placed](char&) { 
+			char name[16] {};
+			pthread_getname_np(pthread_self(), name, sizeof(name));
+			placed = string(name) == "svc0" && sched_getcpu() == 0;
+		}, threads);
+
+		char data {'c'};
+		tc.enqueue(data);
+	}
+	
+	return placed;
+}
+
+// routine runs the same load under every wait policy: all elements are processed before join
+bool test_wait_policy() 
+{
+	bool result {true};
+	for (auto policy : {wait_t::BLOCK, wait_t::SPIN, wait_t::POLL}) {
+		atomic<size_t> sum {0};
+		threads_t threads {2};
+		threads.wait = policy;
+		threads.spins = 64;
+		threads.yields = 4;
+		{
+			service<size_t, queue_t::ENQUEUE, ring_queue<size_t, 64>> wp([&sum](size_t& data) { 
+				sum += data; 
+			}, threads);
+
+			for (size_t i {1}; i <= 1000; ++i) {
+				wp.enqueue(i);
+				if (i % 100 == 0) {
+					this_thread::sleep_for(chrono::microseconds {50});
+				}
+			}
+		}
+		result = result && sum == 500500;
+	}
+	return result;
+}
+
+// routine reads back the counters and histograms of a service, all zero without SERVICE_METRICS
+bool test_metrics() 
+{
+	metrics_t m {};
+	{
+		service<int, queue_t::ENQUEUE> mq([](int&) {}, 1);
+		for (int i {0}; i < 100; ++i) {
+			mq.enqueue(i);
+		}
+		mq.shutdown();
+		int late {0};
+		mq.enqueue(late);
+#ifdef SERVICE_METRICS
+		// shutdown does not join, wait for the worker to drain the queue
+		while (mq.metrics().run.total() < 100) {
+			this_thread::yield();
+		}
+#endif
+		m = mq.metrics();
+	}
+
+#ifdef SERVICE_METRICS
+	return m.enqueued == 100 && m.dequeued == 100 && m.dropped == 1 && m.depth == 0 
+		&& m.peak >= 1 && m.wait.total() == 100 && m.unstamped == 0 && m.run.total() == 100 
+		&& m.run.percentile(0.5) <= m.run.percentile(0.99);
+#else
+	return m.enqueued == 0 && m.wait.total() == 0;
+#endif
+}
+
 int main() 
 {
 	bool result = test_ende_queues();
@@ -75,6 +310,22 @@ int main()
 	result = test_no_queue();
 	assert(result);
 	cout << endl << flush;
+	result = test_ring_queue();
+	assert(result);
+	result = test_bulk_queue();
+	assert(result);
+	result = test_steal_queue();
+	assert(result);
+	result = test_elastic_pool();
+	assert(result);
+	result = test_level_queue();
+	assert(result);
+	result = test_thread_config();
+	assert(result);
+	result = test_wait_policy();
+	assert(result);
+	result = test_metrics();
+	assert(result);
 	
 	return 0;
 }
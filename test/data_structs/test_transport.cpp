@@ -0,0 +1,200 @@
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <span>
+#include <vector>
+
+#include "bluegrass/connection_pool.hpp"
+#include "bluegrass/router.hpp"
+#include "loopback.hpp"
+
+using namespace std;
+using namespace bluegrass;
+
+uint16_t const PORT {0x1001};
+uint16_t const ROUTER_PORT {0x1007};
+uint16_t const SINK_PORT {0x1008};
+uint16_t const FLAT_PORT {0x1009};
+
+struct reading_t {
+	uint8_t sensor;
+	vector<uint32_t> samples;
+};
+
+template <>
+struct bluegrass::described<reading_t> : fields<&reading_t::sensor, &reading_t::samples> {};
+
+// answers every number with its successor until the client hangs up
+void echo(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	for (size_t n; us.receive(as_writable_bytes(span {&n, 1})) == sizeof(n);) {
+		++n;
+		us.send(&n);
+	}
+}
+
+// last payload a routed service received, behind its 3 byte router header
+atomic<uint32_t> delivered {0};
+
+void sink(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	while (auto buffer {us.receive_buffer()}) {
+		uint32_t value {0};
+		if (buffer.size() == 3 + sizeof(value)) {
+			memcpy(&value, buffer.data() + 3, sizeof(value));
+			delivered = value;
+		}
+	}
+}
+
+// sum of the samples of the last reading a routed service received in place
+atomic<uint32_t> summed {0};
+
+void flat_sink(bluegrass::socket& conn)
+{
+	scoped_socket us {std::move(conn)};
+	while (auto reading {router::receive<reading_t>(us)}) {
+		uint32_t sum {0};
+		for (auto sample : reading.get<&reading_t::samples>()) {
+			sum += sample;
+		}
+		summed = sum;
+	}
+}
+
+// routine runs a request over an async_socket server and a client socket
+bool test_socket()
+{
+	loopback_t<echo, 2> link {PORT};
+
+	size_t n {41};
+	bool result {link.client.send(&n) && link.client.receive(&n) && n == 42};
+
+	// link options describe L2CAP links only
+	auto options {link.client.link()};
+	result = result && !options.imtu && !options.omtu && options.sndbuf > 0;
+
+	cout << "loopback socket answered " << n << endl;
+	return result;
+}
+
+// routine reuses one connection across two borrows
+bool test_pool()
+{
+	async_socket::service_handle svc {echo, 2};
+	async_socket server {ANY, PORT, svc, async_t::SERVER};
+	connection_pool pool {};
+
+	bool result {true};
+	for (size_t i {0}; i < 2; ++i) {
+		auto lease {pool.borrow(DEVICE, PORT)};
+		size_t n {i};
+		result = result && lease.reused() == (i == 1);
+		result = result && lease->send(&n) && lease->receive(&n) && n == i + 1;
+	}
+	result = result && pool.idle() == 1;
+
+	// an answer left unread fails the health check: the connection is replaced
+	{
+		auto lease {pool.borrow(DEVICE, PORT)};
+		size_t n {0};
+		lease->send(&n);
+	}
+	this_thread::sleep_for(chrono::milliseconds {50});
+	auto lease {pool.borrow(DEVICE, PORT)};
+	result = result && !lease.reused() && pool.idle() == 0;
+
+	lease.discard();
+	return result;
+}
+
+// routine lists the devices listening in the transport directory
+bool test_discover()
+{
+	async_socket::service_handle svc {echo, 2};
+	async_socket first {ANY, PORT, svc, async_t::SERVER};
+
+	bdaddr_t other {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+	LOOPBACK.self(other);
+	async_socket second {ANY, PORT, svc, async_t::SERVER};
+	LOOPBACK.self(DEVICE);
+
+	vector<bdaddr_t> devices {};
+	LOOPBACK.discover(8, devices);
+	return devices.size() == 1 && devices[0] == other;
+}
+
+// waits up to a second for "done"
+template <class F>
+bool eventually(F done)
+{
+	for (size_t i {0}; i < 100 && !done(); ++i) {
+		this_thread::sleep_for(chrono::milliseconds {10});
+	}
+	return done();
+}
+
+// routine connects two routers, publishes services on one and triggers them from the other
+bool test_router()
+{
+	uint8_t const ONBOARDED {7}, PUBLISHED {8}, DESCRIBED {9};
+	bdaddr_t other {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+	// the services are a connection to a server of the publishing device
+	async_socket::service_handle svc {sink, 1};
+	async_socket server {ANY, SINK_PORT, svc, async_t::SERVER};
+	async_socket handler {DEVICE, SINK_PORT, svc, async_t::CLIENT};
+	async_socket::service_handle flat_svc {flat_sink, 1};
+	async_socket flat_server {ANY, FLAT_PORT, flat_svc, async_t::SERVER};
+	async_socket flat_handler {DEVICE, FLAT_PORT, flat_svc, async_t::CLIENT};
+	router publisher {ROUTER_PORT};
+	publisher.publish(ONBOARDED, handler);
+
+	// the second router learns the first service while it onboards
+	LOOPBACK.self(other);
+	router subscriber {ROUTER_PORT};
+	LOOPBACK.self(DEVICE);
+
+	uint32_t payload {0xC0FFEE};
+	bool result {subscriber.available(ONBOARDED) && subscriber.trigger(ONBOARDED, payload)};
+	result = result && eventually([&] { return delivered == payload; });
+
+	// the first router knows its neighbor once a trigger came through it: a new service is notified
+	publisher.publish(PUBLISHED, handler);
+	result = result && eventually([&] { return subscriber.available(PUBLISHED); });
+
+	payload = 0xBEEF;
+	result = result && subscriber.trigger(PUBLISHED, payload);
+	result = result && eventually([&] { return delivered == payload; });
+
+	// a described type comes out of its router header aligned, its samples are read in place
+	publisher.publish(DESCRIBED, flat_handler);
+	result = result && eventually([&] { return subscriber.available(DESCRIBED); });
+	result = result && subscriber.trigger(DESCRIBED, reading_t {1, {20, 21, 23}});
+	result = result && eventually([&] { return summed == 64; });
+
+	cout << "router delivered " << hex << delivered << dec << endl;
+	return result;
+}
+
+int main()
+{
+	transport::use(LOOPBACK);
+
+	bool result = test_socket();
+	assert(result);
+	result = test_pool();
+	assert(result);
+	result = test_discover();
+	assert(result);
+	result = test_router();
+	assert(result);
+
+	return 0;
+}
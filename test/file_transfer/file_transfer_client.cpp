@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <array>
 #include <vector>
 
 #include "file_transfer.hpp"
@@ -13,7 +14,8 @@ using namespace bluegrass;
 int main() 
 {
 	vector<device_t> devices;
-	struct packet_t packet {0, 0};
+	array<struct packet_t, 16> packets {};
+	array<ssize_t, 16> results {};
 	
 	// find addresses of all nearby discoverable Bluetooth devices
 	hci& controller = hci::access();
@@ -30,11 +32,20 @@ int main()
 			cout << "Sending local device address to server\n" << flush;
 			us << &local;
 			
+			// every call takes all the packets already queued, up to 16
 			cout << "Receiving file from server\n" << flush;
-			do {
-				us >> &packet;
-				cout.write((const char*) packet.data, packet.size) << flush;
-			} while (packet.size == sizeof packet.data);
+			for (bool more {true}; more;) {
+				size_t n {us.receive_many(packets.data(), packets.size(), results.data())};
+				more = n > 0;
+				for (size_t i {0}; i < n && more; ++i) {
+					// a server which hung up leaves empty entries holding stale packets
+					more = results[i] == static_cast<ssize_t>(sizeof packets[i]);
+					if (more) {
+						cout.write((const char*) packets[i].data, packets[i].size) << flush;
+						more = packets[i].size == sizeof packets[i].data;
+					}
+				}
+			}
 		} catch (...) {
 			cout << "Client construction failed\n";
 		}
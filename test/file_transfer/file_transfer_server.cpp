@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <array>
 
 #include "file_transfer.hpp"
 
@@ -15,8 +16,9 @@ void transfer(bluegrass::socket& conn)
 	scoped_socket us(std::move(conn));
 	
 	bdaddr_t peer {0};
-	struct packet_t packet {0, 0};
-	uint8_t count {1};
+	array<struct packet_t, 16> packets {};
+	array<ssize_t, 16> results {};
+	size_t count {1};
 	
 	// find out who the client is
 	cout << "Receiving address of client\n" << flush;
@@ -27,16 +29,25 @@ void transfer(bluegrass::socket& conn)
 	ifstream file("zimmermann.txt", ios::binary);
 	cout << "Transfering file \"zimmermann.txt\" to client\n" << flush;
 	
-	// print status of each packet sent
+	// send up to 16 packets per call and print status of each packet sent
 	while (file.good()) {
-		file.read((char*) packet.data, sizeof packet.data);
-		packet.size = file.gcount();
-		cout << '[' << peer << ']' << " sending packet " << (int) count++;
-		
-		if (us.send(&packet)) {
-			cout << " [success]\n" << flush;
-		} else {
-			cout << " [failure]\n" << flush;
+		size_t n {0};
+		for (; n < packets.size() && file.good(); ++n) {
+			file.read((char*) packets[n].data, sizeof packets[n].data);
+			packets[n].size = file.gcount();
+		}
+
+		size_t sent {us.send_many(packets.data(), n, results.data())};
+		for (size_t i {0}; i < n; ++i) {
+			cout << '[' << peer << ']' << " sending packet " << count++;
+			if (results[i] >= 0) {
+				cout << " [success]\n" << flush;
+			} else {
+				cout << " [failure]\n" << flush;
+			}
+		}
+
+		if (sent < n) {
 			return;
 		}
 	}
@@ -1,6 +1,6 @@
 #include <iostream>
 #include <cstdlib>
-#include <cstring>
+#include <string>
 
 #include "bluegrass/bluetooth.hpp"
 #include "bluegrass/router.hpp"
@@ -9,18 +9,23 @@
 
 using namespace bluegrass;
 
+// only the characters typed go on the air
 struct message_t {
-	char usr[8];
-	char msg[64];
+	std::string usr;
+	std::string msg;
 };
 
+template <>
+struct bluegrass::described<message_t> : fields<&message_t::usr, &message_t::msg> {};
+
 void chat(bluegrass::socket& conn) 
 {
 	scoped_socket us(std::move(conn));
-	message_t m;
 
-	us >> &m;
-	std::cout << '[' << m.usr << "]\t" << m.msg << std::endl;
+	// the strings are read straight from the receive buffer, behind the router header
+	if (auto m {router::receive<message_t>(us)}) {
+		std::cout << '[' << m.get<&message_t::usr>() << "]\t" << m.get<&message_t::msg>() << std::endl;
+	}
 }
 
 int main(int argc, char** argv) 
@@ -35,9 +40,7 @@ int main(int argc, char** argv)
 	async_socket chat_socket {ANY, 0x1003, chat_queue, async_t::SERVER};
 
 	int self {atoi(argv[1])}, svc;
-	message_t message;
-	strncpy(message.usr, argv[2], 8);
-	message.usr[7] = '\0';
+	message_t message {argv[2], {}};
 
 	network.publish(self, chat_socket);
 
@@ -49,8 +52,9 @@ int main(int argc, char** argv)
 			if (std::cin >> svc && network.available(svc)) {
 				std::cout << "Enter message: ";
 				std::cin >> message.msg;
-				message.msg[63] = '\0';
-				network.trigger(svc, message);
+				if (!network.trigger(svc, message)) {
+					std::cout << "Message not sent\n";
+				}
 			} else {
 				std::cout << "Service unavailable\n";
 			}